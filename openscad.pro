@@ -243,6 +243,7 @@ HEADERS += src/typedefs.h \
            src/csgtermnormalizer.h \
            src/dxfdata.h \
            src/dxfdim.h \
+           src/svgimport.h \
            src/export.h \
            src/expression.h \
            src/function.h \
@@ -282,8 +283,11 @@ HEADERS += src/typedefs.h \
            src/nodedumper.h \
            src/ModuleCache.h \
            src/GeometryCache.h \
+           src/ImportCache.h \
+           src/GlyphCache.h \
            src/GeometryEvaluator.h \
            src/CSGTermEvaluator.h \
+           src/CSGTermCache.h \
            src/Tree.h \
 src/DrawingCallback.h \
 src/FreetypeRenderer.h \
@@ -300,6 +304,7 @@ src/FontCache.h \
            \
            src/lodepng.h \
            src/OffscreenView.h \
+           src/SoftwareRasterizer.h \
            src/OffscreenContext.h \
            src/OffscreenContextAll.hpp \
            src/fbo.h \
@@ -364,6 +369,8 @@ SOURCES += src/version_check.cc \
            src/GeometryEvaluator.cc \
            src/ModuleCache.cc \
            src/GeometryCache.cc \
+           src/ImportCache.cc \
+           src/GlyphCache.cc \
            src/Tree.cc \
 src/DrawingCallback.cc \
 src/FreetypeRenderer.cc \
@@ -382,11 +389,14 @@ src/FontCache.cc \
            src/calc.cc \
            src/export.cc \
            src/export_png.cc \
+           src/SoftwareRasterizer.cc \
            src/import.cc \
+           src/svgimport.cc \
            src/renderer.cc \
            src/colormap.cc \
            src/ThrownTogetherRenderer.cc \
            src/CSGTermEvaluator.cc \
+           src/CSGTermCache.cc \
            src/svg.cc \
            src/OffscreenView.cc \
            src/fbo.cc \
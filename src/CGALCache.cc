@@ -1,10 +1,11 @@
 #include "CGALCache.h"
 #include "printutils.h"
 #include "CGAL_Nef_polyhedron.h"
+#include <boost/foreach.hpp>
 
 CGALCache *CGALCache::inst = NULL;
 
-CGALCache::CGALCache(size_t limit) : cache(limit)
+CGALCache::CGALCache(size_t limit) : cache(limit), decompositions(16*1024*1024)
 {
 }
 
@@ -40,6 +41,22 @@ void CGALCache::setMaxSize(size_t limit)
 void CGALCache::clear()
 {
 	cache.clear();
+	decompositions.clear();
+}
+
+shared_ptr<const CGALCache::ConvexParts> CGALCache::getDecomposition(const shared_ptr<const Geometry> &geom) const
+{
+	const decomposition_entry *entry = this->decompositions[geom.get()];
+	// The address may have been reused by another geometry since insertion
+	if (!entry || entry->geom.lock() != geom) return shared_ptr<const ConvexParts>();
+	return entry->parts;
+}
+
+void CGALCache::insertDecomposition(const shared_ptr<const Geometry> &geom, const shared_ptr<const ConvexParts> &parts)
+{
+	size_t cost = sizeof(decomposition_entry);
+	BOOST_FOREACH(const std::vector<Vector3d> &part, *parts) cost += part.size() * sizeof(Vector3d);
+	this->decompositions.insert(geom.get(), new decomposition_entry(geom, parts), cost);
 }
 
 void CGALCache::print()
@@ -2,6 +2,9 @@
 
 #include "cache.h"
 #include "memory.h"
+#include "linalg.h"
+#include <vector>
+#include <boost/weak_ptr.hpp>
 
 /*!
 */
@@ -20,9 +23,27 @@ public:
 	void clear();
 	void print();
 
+	/*!
+		Convex decomposition of a minkowski() operand, as the vertices of each
+		convex part. Entries are keyed by the operand geometry and expire
+		together with it.
+	*/
+	typedef std::vector<std::vector<Vector3d> > ConvexParts;
+	shared_ptr<const ConvexParts> getDecomposition(const shared_ptr<const class Geometry> &geom) const;
+	void insertDecomposition(const shared_ptr<const Geometry> &geom, const shared_ptr<const ConvexParts> &parts);
+
 private:
 	static CGALCache *inst;
 
+	struct decomposition_entry {
+		boost::weak_ptr<const Geometry> geom;
+		shared_ptr<const ConvexParts> parts;
+		decomposition_entry(const shared_ptr<const Geometry> &geom, const shared_ptr<const ConvexParts> &parts)
+			: geom(geom), parts(parts) { }
+	};
+
+	Cache<const Geometry *, decomposition_entry> decompositions;
+
 	struct cache_entry {
 		shared_ptr<const CGAL_Nef_polyhedron> N;
 		std::string msg;
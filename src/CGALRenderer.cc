@@ -38,6 +38,10 @@
 #include "CGAL_OGL_Polyhedron.h"
 #include "CGAL_Nef_polyhedron.h"
 #include "cgal.h"
+#include "grid.h"
+
+#include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
 
 //#include "Preferences.h"
 
@@ -78,6 +82,79 @@ void CGALRenderer::buildPolyhedron() const
 	PRINTD("buildPolyhedron() end");
 }
 
+/*!
+	Collects the edges of a triangle mesh that are drawn as edges of the
+	object: edges between non-coplanar triangles and open edges. The
+	diagonals introduced by tessellating planar facets are skipped.
+*/
+static void build_feature_edges(const PolySet &ps, std::vector<float> &edges)
+{
+	struct EdgeInfo {
+		Vector3d normal;
+		int count;
+		bool feature;
+	};
+	typedef boost::unordered_map<std::pair<int,int>, EdgeInfo> EdgeMap;
+
+	Grid3d<int> grid(GRID_FINE);
+	std::vector<Vector3d> vertices;
+	EdgeMap edgemap;
+	BOOST_FOREACH(const PolySet::Polygon &poly, ps.polygons) {
+		if (poly.size() < 3) continue;
+		Vector3d normal = (poly[1] - poly[0]).cross(poly[2] - poly[0]);
+		if (normal.squaredNorm() == 0) continue;
+		normal.normalize();
+
+		std::vector<int> idx;
+		BOOST_FOREACH(Vector3d v, poly) {
+			if (!grid.has(v[0], v[1], v[2])) {
+				grid.align(v[0], v[1], v[2]) = vertices.size();
+				vertices.push_back(v);
+			}
+			idx.push_back(grid.data(v[0], v[1], v[2]));
+		}
+		for (size_t i = 0; i < idx.size(); i++) {
+			int a = idx[i], b = idx[(i + 1) % idx.size()];
+			if (a == b) continue;
+			std::pair<EdgeMap::iterator, bool> res = edgemap.insert(std::make_pair(std::make_pair(std::min(a, b), std::max(a, b)), EdgeInfo()));
+			EdgeInfo &info = res.first->second;
+			if (res.second) {
+				info.normal = normal;
+				info.count = 1;
+				info.feature = false;
+			}
+			else {
+				info.count++;
+				if (info.normal.dot(normal) < 1 - 1e-6) info.feature = true;
+			}
+		}
+	}
+
+	edges.clear();
+	BOOST_FOREACH(const EdgeMap::value_type &e, edgemap) {
+		if (!e.second.feature && e.second.count != 1) continue;
+		const Vector3d &p = vertices[e.first.first];
+		const Vector3d &q = vertices[e.first.second];
+		edges.push_back(p[0]); edges.push_back(p[1]); edges.push_back(p[2]);
+		edges.push_back(q[0]); edges.push_back(q[1]); edges.push_back(q[2]);
+	}
+}
+
+/*!
+	Returns the triangle mesh of N, which is shared with the exporters
+	through CGAL_Nef_polyhedron::getMesh(). Drawing it through
+	PolySet::render_surface() uses its cached vertex arrays, which avoids
+	the OGL Nef converter and the GLU tessellation of every facet.
+*/
+shared_ptr<const PolySet> CGALRenderer::getMesh() const
+{
+	if (this->N && !this->mesh) {
+		this->mesh = this->N->getMesh();
+		if (this->mesh) build_feature_edges(*this->mesh, this->feature_edges);
+	}
+	return this->mesh;
+}
+
 // Overridden from Renderer
 void CGALRenderer::setColorScheme(const ColorScheme &cs)
 {
@@ -123,13 +200,33 @@ void CGALRenderer::draw(bool showfaces, bool showedges) const
 			this->polyset->render_surface(CSGMODE_NORMAL, Transform3d::Identity(), NULL);
 		}
 	}
+	else if (showfaces) {
+		shared_ptr<const PolySet> mesh = getMesh();
+		if (mesh) {
+			PRINTD("draw() mesh");
+			Color4f c = ColorMap::getColor(*this->colorscheme, CGAL_FACE_FRONT_COLOR);
+			setColor(c.data());
+			mesh->render_surface(CSGMODE_NORMAL, Transform3d::Identity(), NULL);
+
+			if (showedges && !this->feature_edges.empty()) {
+				glDisable(GL_LIGHTING);
+				glLineWidth(5);
+				Color4f e = ColorMap::getColor(*this->colorscheme, CGAL_EDGE_FRONT_COLOR);
+				glColor3f(e[0], e[1], e[2]);
+				glEnableClientState(GL_VERTEX_ARRAY);
+				glVertexPointer(3, GL_FLOAT, 0, &this->feature_edges[0]);
+				glDrawArrays(GL_LINES, 0, this->feature_edges.size() / 3);
+				glDisableClientState(GL_VERTEX_ARRAY);
+				glEnable(GL_LIGHTING);
+			}
+		}
+	}
 	else {
 		shared_ptr<class CGAL_OGL_Polyhedron> polyhedron = getPolyhedron();
         if (polyhedron) {
             PRINTD("draw() polyhedron");
-            if (showfaces) polyhedron->set_style(SNC_BOUNDARY);
-            else polyhedron->set_style(SNC_SKELETON);
-            polyhedron->draw(showfaces && showedges);
+            polyhedron->set_style(SNC_SKELETON);
+            polyhedron->draw(false);
         }
 	}
 	PRINTD("draw() end");
@@ -143,13 +240,8 @@ BoundingBox CGALRenderer::getBoundingBox() const
 		bbox = this->polyset->getBoundingBox();
 	}
 	else {
-		shared_ptr<class CGAL_OGL_Polyhedron> polyhedron = getPolyhedron();
-		if (polyhedron) {
-			CGAL::Bbox_3 cgalbbox = polyhedron->bbox();
-			bbox = BoundingBox(
-				Vector3d(cgalbbox.xmin(), cgalbbox.ymin(), cgalbbox.zmin()),
-				Vector3d(cgalbbox.xmax(), cgalbbox.ymax(), cgalbbox.zmax()));
-		}
+		shared_ptr<const PolySet> mesh = getMesh();
+		if (mesh) bbox = mesh->getBoundingBox();
 	}
 	return bbox;
 }
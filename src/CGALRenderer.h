@@ -2,6 +2,7 @@
 
 #include "renderer.h"
 #include "CGAL_Nef_polyhedron.h"
+#include <vector>
 
 class CGALRenderer : public Renderer
 {
@@ -15,8 +16,13 @@ public:
 private:
 	shared_ptr<class CGAL_OGL_Polyhedron> getPolyhedron() const;
 	void buildPolyhedron() const;
+	shared_ptr<const class PolySet> getMesh() const;
 
+	// Only used for the vertex/edge view (showfaces off)
 	mutable shared_ptr<class CGAL_OGL_Polyhedron> polyhedron;
+	// Triangle mesh of N and its feature edges as GL_LINES vertices
+	mutable shared_ptr<const class PolySet> mesh;
+	mutable std::vector<float> feature_edges;
 	shared_ptr<const CGAL_Nef_polyhedron> N;
 	shared_ptr<const class PolySet> polyset;
 };
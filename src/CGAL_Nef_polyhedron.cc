@@ -18,27 +18,55 @@ CGAL_Nef_polyhedron::CGAL_Nef_polyhedron(const CGAL_Nef_polyhedron &src)
 CGAL_Nef_polyhedron& CGAL_Nef_polyhedron::operator+=(const CGAL_Nef_polyhedron &other)
 {
 	(*this->p3) += (*other.p3);
+	this->mesh.reset();
 	return *this;
 }
 
 CGAL_Nef_polyhedron& CGAL_Nef_polyhedron::operator*=(const CGAL_Nef_polyhedron &other)
 {
 	(*this->p3) *= (*other.p3);
+	this->mesh.reset();
 	return *this;
 }
 
 CGAL_Nef_polyhedron& CGAL_Nef_polyhedron::operator-=(const CGAL_Nef_polyhedron &other)
 {
 	(*this->p3) -= (*other.p3);
+	this->mesh.reset();
 	return *this;
 }
 
 CGAL_Nef_polyhedron &CGAL_Nef_polyhedron::minkowski(const CGAL_Nef_polyhedron &other)
 {
 	(*this->p3) = CGAL::minkowski_sum_3(*this->p3, *other.p3);
+	this->mesh.reset();
 	return *this;
 }
 
+/*!
+	Returns the boundary of this polyhedron as a triangle mesh. The mesh is
+	built once by CGALUtils::createPolySetFromNefPolyhedron3() and shared
+	between the renderers and the exporters.
+
+	Returns an empty pointer if the conversion failed.
+*/
+shared_ptr<const PolySet> CGAL_Nef_polyhedron::getMesh() const
+{
+	if (!this->mesh) {
+		PolySet *ps = new PolySet(3);
+		shared_ptr<const PolySet> result(ps);
+		if (this->p3) {
+			ps->setConvexity(this->convexity);
+			if (CGALUtils::createPolySetFromNefPolyhedron3(*this->p3, *ps)) {
+				PRINT("ERROR: Nef->PolySet failed");
+				return shared_ptr<const PolySet>();
+			}
+		}
+		this->mesh = result;
+	}
+	return this->mesh;
+}
+
 size_t CGAL_Nef_polyhedron::memsize() const
 {
 	if (this->isEmpty()) return 0;
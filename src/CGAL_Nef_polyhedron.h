@@ -22,7 +22,7 @@ public:
 	virtual bool isEmpty() const { return !p3; }
 	virtual Geometry *copy() const { return new CGAL_Nef_polyhedron(*this); }
 
-	void reset() { p3.reset(); }
+	void reset() { p3.reset(); mesh.reset(); }
 	CGAL_Nef_polyhedron &operator+=(const CGAL_Nef_polyhedron &other);
 	CGAL_Nef_polyhedron &operator*=(const CGAL_Nef_polyhedron &other);
 	CGAL_Nef_polyhedron &operator-=(const CGAL_Nef_polyhedron &other);
@@ -31,6 +31,11 @@ public:
 //	class PolySet *convertToPolyset() const;
 	void transform( const Transform3d &matrix );
 	void resize(Vector3d newsize, const Eigen::Matrix<bool,3,1> &autosize);
+	shared_ptr<const class PolySet> getMesh() const;
 
 	shared_ptr<CGAL_Nef_polyhedron3> p3;
+
+private:
+	// Triangulated boundary, see getMesh(). Dropped by all modifiers.
+	mutable shared_ptr<const class PolySet> mesh;
 };
@@ -0,0 +1,16 @@
+#include "CSGTermCache.h"
+#include "csgterm.h"
+#include "printutils.h"
+
+CSGTermCache *CSGTermCache::inst = NULL;
+
+bool CSGTermCache::insert(const std::string &id, const Entry &entry)
+{
+	if (entry.term) entry.term->shared = true;
+	return this->cache.insert(id, new Entry(entry));
+}
+
+void CSGTermCache::print()
+{
+	PRINTB("CSG terms in cache: %d", this->cache.size());
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "cache.h"
+#include "memory.h"
+#include <string>
+#include <vector>
+
+class CSGTerm;
+
+/*!
+	Keeps the raw CSG terms of evaluated subtrees across preview compilations,
+	keyed by the subtree's id string and the state it was evaluated in.
+
+	Terms stored here are shared between compilations and must be treated as
+	immutable, see CSGTerm::shared.
+*/
+class CSGTermCache
+{
+public:
+	CSGTermCache(size_t limit = 100000) : cache(limit) {}
+
+	static CSGTermCache *instance() { if (!inst) inst = new CSGTermCache; return inst; }
+
+	struct Entry {
+		shared_ptr<CSGTerm> term;
+		// Highlight and background terms contributed by the subtree
+		std::vector<shared_ptr<CSGTerm> > highlights;
+		std::vector<shared_ptr<CSGTerm> > background;
+	};
+
+	bool contains(const std::string &id) const { return this->cache.contains(id); }
+	const Entry &get(const std::string &id) const { return *this->cache[id]; }
+	bool insert(const std::string &id, const Entry &entry);
+	size_t maxSize() const { return this->cache.maxCost(); }
+	void setMaxSize(size_t limit) { this->cache.setMaxCost(limit); }
+	void clear() { cache.clear(); }
+	void print();
+
+private:
+	static CSGTermCache *inst;
+
+	Cache<std::string, Entry> cache;
+};
@@ -26,6 +26,9 @@
 
 	A visitor responsible for creating a tree of CSGTerm nodes used for rendering
 	with OpenCSG.
+
+	The terms of subtrees with children are kept in the CSGTermCache, so after
+	an edit only the branches which actually changed are traversed again.
 */
 
 shared_ptr<CSGTerm> CSGTermEvaluator::evaluateCSGTerm(const AbstractNode &node, 
@@ -58,6 +61,7 @@ void CSGTermEvaluator::applyToChildren(const AbstractNode &node, CSGTermEvaluato
 		}
 	}
 	if (t1 && node.modinst->isHighlight()) {
+		if (t1->shared) t1 = t1->clone();
 		t1->flag = CSGTerm::FLAG_HIGHLIGHT;
 		this->highlights.push_back(t1);
 	}
@@ -70,8 +74,12 @@ void CSGTermEvaluator::applyToChildren(const AbstractNode &node, CSGTermEvaluato
 
 Response CSGTermEvaluator::visit(State &state, const AbstractNode &node)
 {
+	if (state.isPrefix() && isCached(state, node)) return PruneTraversal;
 	if (state.isPostfix()) {
-		applyToChildren(node, CSGT_UNION);
+		if (!getCachedTerm(node)) {
+			applyToChildren(node, CSGT_UNION);
+			cacheTerm(node);
+		}
 		addToParent(state, node);
 	}
 	return ContinueTraversal;
@@ -79,8 +87,12 @@ Response CSGTermEvaluator::visit(State &state, const AbstractNode &node)
 
 Response CSGTermEvaluator::visit(State &state, const AbstractIntersectionNode &node)
 {
+	if (state.isPrefix() && isCached(state, node)) return PruneTraversal;
 	if (state.isPostfix()) {
-		applyToChildren(node, CSGT_INTERSECTION);
+		if (!getCachedTerm(node)) {
+			applyToChildren(node, CSGT_INTERSECTION);
+			cacheTerm(node);
+		}
 		addToParent(state, node);
 	}
 	return ContinueTraversal;
@@ -125,7 +137,8 @@ Response CSGTermEvaluator::visit(State &state, const AbstractPolyNode &node)
 
 Response CSGTermEvaluator::visit(State &state, const CsgNode &node)
 {
-	if (state.isPostfix()) {
+	if (state.isPrefix() && isCached(state, node)) return PruneTraversal;
+	if (state.isPostfix() && !getCachedTerm(node)) {
 		CsgOp op = CSGT_UNION;
 		switch (node.type) {
 		case OPENSCAD_UNION:
@@ -141,18 +154,23 @@ Response CSGTermEvaluator::visit(State &state, const CsgNode &node)
 			assert(false);
 		}
 		applyToChildren(node, op);
-		addToParent(state, node);
+		cacheTerm(node);
 	}
+	if (state.isPostfix()) addToParent(state, node);
 	return ContinueTraversal;
 }
 
 Response CSGTermEvaluator::visit(State &state, const TransformNode &node)
 {
 	if (state.isPrefix()) {
+		if (isCached(state, node)) return PruneTraversal;
 		state.setMatrix(state.matrix() * node.matrix);
 	}
 	if (state.isPostfix()) {
-		applyToChildren(node, CSGT_UNION);
+		if (!getCachedTerm(node)) {
+			applyToChildren(node, CSGT_UNION);
+			cacheTerm(node);
+		}
 		addToParent(state, node);
 	}
 	return ContinueTraversal;
@@ -161,10 +179,14 @@ Response CSGTermEvaluator::visit(State &state, const TransformNode &node)
 Response CSGTermEvaluator::visit(State &state, const ColorNode &node)
 {
 	if (state.isPrefix()) {
+		if (isCached(state, node)) return PruneTraversal;
 		if (!state.color().isValid()) state.setColor(node.color);
 	}
 	if (state.isPostfix()) {
-		applyToChildren(node, CSGT_UNION);
+		if (!getCachedTerm(node)) {
+			applyToChildren(node, CSGT_UNION);
+			cacheTerm(node);
+		}
 		addToParent(state, node);
 	}
 	return ContinueTraversal;
@@ -173,7 +195,8 @@ Response CSGTermEvaluator::visit(State &state, const ColorNode &node)
 // FIXME: If we've got CGAL support, render this node as a CGAL union into a PolySet
 Response CSGTermEvaluator::visit(State &state, const RenderNode &node)
 {
-	if (state.isPostfix()) {
+	if (state.isPrefix() && isCached(state, node)) return PruneTraversal;
+	if (state.isPostfix() && !getCachedTerm(node)) {
 		shared_ptr<CSGTerm> t1;
 		shared_ptr<const Geometry> geom;
 		if (this->geomevaluator) {
@@ -183,14 +206,16 @@ Response CSGTermEvaluator::visit(State &state, const RenderNode &node)
 			node.progress_report();
 		}
 		this->stored_term[node.index()] = t1;
-		addToParent(state, node);
+		cacheTerm(node);
 	}
+	if (state.isPostfix()) addToParent(state, node);
 	return ContinueTraversal;
 }
 
 Response CSGTermEvaluator::visit(State &state, const CgaladvNode &node)
 {
-	if (state.isPostfix()) {
+	if (state.isPrefix() && isCached(state, node)) return PruneTraversal;
+	if (state.isPostfix() && !getCachedTerm(node)) {
 		shared_ptr<CSGTerm> t1;
     // FIXME: Calling evaluator directly since we're not a PolyNode. Generalize this.
 		shared_ptr<const Geometry> geom;
@@ -201,8 +226,9 @@ Response CSGTermEvaluator::visit(State &state, const CgaladvNode &node)
 			node.progress_report();
 		}
 		this->stored_term[node.index()] = t1;
-		addToParent(state, node);
+		cacheTerm(node);
 	}
+	if (state.isPostfix()) addToParent(state, node);
 	return ContinueTraversal;
 }
 
@@ -218,3 +244,62 @@ void CSGTermEvaluator::addToParent(const State &state, const AbstractNode &node)
 		this->visitedchildren[state.parent()->index()].push_back(&node);
 	}
 }
+
+/*!
+	Subtrees with children are looked up in the CSGTermCache. Since terms
+	carry the accumulated transformation and color, the key includes the
+	state the subtree is evaluated in, as well as the node's own modifiers
+	which are not part of its id string.
+
+	Call this from the prefix visit; returns true if traversal of the
+	subtree can be pruned.
+*/
+bool CSGTermEvaluator::isCached(const State &state, const AbstractNode &node)
+{
+	if (!this->geomevaluator || node.getChildren().empty()) return false;
+
+	std::stringstream key;
+	key.precision(17);
+	if (node.modinst->isBackground()) key << "%";
+	if (node.modinst->isHighlight()) key << "#";
+	key << this->tree.getIdString(node) << "\n" << state.matrix().matrix() << "\n" << state.color().transpose();
+
+	PendingTerm &pending = this->pendingterms[node.index()];
+	pending.key = key.str();
+	pending.hit = CSGTermCache::instance()->contains(pending.key);
+	// Copy the entry now; evaluating other subtrees may evict it
+	if (pending.hit) pending.entry = CSGTermCache::instance()->get(pending.key);
+	pending.highlights = this->highlights.size();
+	pending.background = this->background.size();
+	return pending.hit;
+}
+
+/*!
+	Call this from the postfix visit. On a cache hit, restores the term and
+	the highlight and background terms of the subtree and returns true.
+*/
+bool CSGTermEvaluator::getCachedTerm(const AbstractNode &node)
+{
+	std::map<int, PendingTerm>::iterator it = this->pendingterms.find(node.index());
+	if (it == this->pendingterms.end() || !it->second.hit) return false;
+
+	const CSGTermCache::Entry &entry = it->second.entry;
+	this->highlights.insert(this->highlights.end(), entry.highlights.begin(), entry.highlights.end());
+	this->background.insert(this->background.end(), entry.background.begin(), entry.background.end());
+	this->stored_term[node.index()] = entry.term;
+	this->pendingterms.erase(it);
+	return true;
+}
+
+void CSGTermEvaluator::cacheTerm(const AbstractNode &node)
+{
+	std::map<int, PendingTerm>::iterator it = this->pendingterms.find(node.index());
+	if (it == this->pendingterms.end()) return;
+
+	CSGTermCache::Entry entry;
+	entry.term = this->stored_term[node.index()];
+	entry.highlights.assign(this->highlights.begin() + it->second.highlights, this->highlights.end());
+	entry.background.assign(this->background.begin() + it->second.background, this->background.end());
+	CSGTermCache::instance()->insert(it->second.key, entry);
+	this->pendingterms.erase(it);
+}
@@ -1,11 +1,13 @@
 #pragma once
 
 #include <map>
+#include <string>
 #include <list>
 #include <vector>
 #include <cstddef>
 #include "visitor.h"
 #include "memory.h"
+#include "CSGTermCache.h"
 
 class CSGTermEvaluator : public Visitor
 {
@@ -32,11 +34,23 @@ private:
 	enum CsgOp {CSGT_UNION, CSGT_INTERSECTION, CSGT_DIFFERENCE, CSGT_MINKOWSKI};
   void addToParent(const State &state, const AbstractNode &node);
 	void applyToChildren(const AbstractNode &node, CSGTermEvaluator::CsgOp op);
+	bool isCached(const State &state, const AbstractNode &node);
+	bool getCachedTerm(const AbstractNode &node);
+	void cacheTerm(const AbstractNode &node);
 
   const AbstractNode *root;
   typedef std::list<const AbstractNode *> ChildList;
 	std::map<int, ChildList> visitedchildren;
 
+	// Subtrees being evaluated, from prefix to postfix visit
+	struct PendingTerm {
+		std::string key;
+		bool hit;
+		CSGTermCache::Entry entry;
+		size_t highlights, background;
+	};
+	std::map<int, PendingTerm> pendingterms;
+
 public:
 	std::map<int, shared_ptr<CSGTerm> > stored_term; // The term evaluated from each node index
 
@@ -29,8 +29,10 @@
 #include <boost/foreach.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include "FontCache.h"
+#include "GlyphCache.h"
 #include "PlatformUtils.h"
 #include "parsersettings.h"
 
@@ -80,9 +82,10 @@ const std::string &FontInfo::get_file() const
 }
 
 FontCache * FontCache::self = NULL;
+size_t FontCache::max_cache_size = FontCache::DEFAULT_MAX_SIZE;
 const std::string FontCache::DEFAULT_FONT("XXX");
 
-FontCache::FontCache()
+FontCache::FontCache() : total_size(0), shaping_cache(4*1024*1024)
 {
 	this->init_ok = false;
 
@@ -166,6 +169,8 @@ void FontCache::register_font_file(const std::string &path)
 	if (!FcConfigAppFontAddFile(this->config, reinterpret_cast<const FcChar8 *> (path.c_str()))) {
 		PRINTB("Can't register font '%s'", path);
 	}
+	// The new font may be a better match for already resolved names
+	this->lookup_cache.clear();
 }
 
 void FontCache::add_font_dir(const std::string &path)
@@ -214,63 +219,131 @@ bool FontCache::is_init_ok() const
 	return this->init_ok;
 }
 
+size_t FontCache::max_size()
+{
+	return max_cache_size;
+}
+
+/*!
+	Sets the limit for the total size of the font files of all open faces.
+	Takes effect on the next font lookup.
+ */
+void FontCache::set_max_size(size_t limit)
+{
+	max_cache_size = limit;
+}
+
 void FontCache::clear()
 {
+	for (face_cache_t::iterator it = this->cache.begin(); it != this->cache.end(); it++) {
+		hb_font_destroy((*it).second.hb_font);
+		FT_Done_Face((*it).second.face);
+	}
 	this->cache.clear();
+	this->lru.clear();
+	this->total_size = 0;
+	this->lookup_cache.clear();
+	this->shaping_cache.clear();
+	GlyphCache::instance()->clear();
 }
 
 void FontCache::dump_cache(const std::string &info)
 {
 	std::cout << info << ":";
-	for (cache_t::iterator it = this->cache.begin(); it != this->cache.end(); it++) {
-		std::cout << " " << (*it).first << " (" << (*it).second.second << ")";
+	for (std::list<std::string>::iterator it = this->lru.begin(); it != this->lru.end(); it++) {
+		std::cout << " " << (*it) << " (" << this->cache[*it].size << ")";
 	}
 	std::cout << std::endl;
 }
 
-void FontCache::check_cleanup()
+void FontCache::touch(const std::string &key)
 {
-	if (this->cache.size() < MAX_NR_OF_CACHE_ENTRIES) {
-		return;
-	}
+	this->lru.remove(key);
+	this->lru.push_front(key);
+}
 
-	cache_t::iterator pos = this->cache.begin()++;
-	for (cache_t::iterator it = this->cache.begin(); it != this->cache.end(); it++) {
-		if ((*pos).second.second > (*it).second.second) {
-			pos = it;
-		}
+/*!
+	Closes least recently used faces until the cache fits into its size
+	limit. The most recently used face is always kept.
+ */
+void FontCache::check_cleanup()
+{
+	while (this->total_size > max_cache_size && this->lru.size() > 1) {
+		face_cache_t::iterator pos = this->cache.find(this->lru.back());
+		hb_font_destroy((*pos).second.hb_font);
+		FT_Done_Face((*pos).second.face);
+		this->total_size -= (*pos).second.size;
+		this->cache.erase(pos);
+		this->lru.pop_back();
 	}
-	FT_Done_Face((*pos).second.first);
-	this->cache.erase(pos);
 }
 
 FT_Face FontCache::get_font(const std::string &font)
 {
-	FT_Face face;
-	cache_t::iterator it = this->cache.find(font);
+	std::string key;
+	lookup_cache_t::iterator lookup = this->lookup_cache.find(font);
+	if (lookup != this->lookup_cache.end()) {
+		key = (*lookup).second;
+	}
+	else {
+		std::string trimmed(font);
+		boost::algorithm::trim(trimmed);
+		const std::string name = trimmed.empty() ? DEFAULT_FONT : trimmed;
+		std::string file;
+		int index;
+		if (!find_font_file(name, file, index)) {
+			return NULL;
+		}
+		PRINTDB("font = \"%s\", lookup = \"%s\", file = \"%s\"", font % name % file);
+		key = file + ":" + boost::lexical_cast<std::string>(index);
+		this->lookup_cache[font] = key;
+	}
+
+	face_cache_t::iterator it = this->cache.find(key);
 	if (it == this->cache.end()) {
-		face = find_face(font);
+		std::string file = key.substr(0, key.rfind(':'));
+		int index = boost::lexical_cast<int>(key.substr(key.rfind(':') + 1));
+		FT_Face face = open_face(file, index);
 		if (!face) {
 			return NULL;
 		}
-		check_cleanup();
-	} else {
-		face = (*it).second.first;
+		PRINTDB("result = \"%s\", style = \"%s\"", face->family_name % face->style_name);
+
+		face_entry_t entry;
+		entry.face = face;
+		entry.hb_font = hb_ft_font_create(face, NULL);
+		boost::system::error_code ec;
+		boost::uintmax_t filesize = fs::file_size(file, ec);
+		entry.size = ec ? 1024*1024 : size_t(filesize);
+		it = this->cache.insert(std::make_pair(key, entry)).first;
+		this->total_size += entry.size;
 	}
-	this->cache[font] = cache_entry_t(face, time(NULL));
-	return face;
+	touch(key);
+	check_cleanup();
+	return (*it).second.face;
 }
 
-FT_Face FontCache::find_face(const std::string &font) const
+/*!
+	Returns the HarfBuzz font belonging to a face returned by get_font().
+	It is owned by the cache and stays valid until the face is evicted.
+ */
+hb_font_t *FontCache::get_hb_font(FT_Face face) const
 {
-	std::string trimmed(font);
-	boost::algorithm::trim(trimmed);
+	for (face_cache_t::const_iterator it = this->cache.begin(); it != this->cache.end(); it++) {
+		if ((*it).second.face == face) return (*it).second.hb_font;
+	}
+	return NULL;
+}
 
-	const std::string lookup = trimmed.empty() ? DEFAULT_FONT : trimmed;
-	PRINTDB("font = \"%s\", lookup = \"%s\"", font % lookup);
-	FT_Face face = find_face_fontconfig(lookup);
-	PRINTDB("result = \"%s\", style = \"%s\"", face->family_name % face->style_name);
-	return face;
+const ShapedText *FontCache::get_shaped_text(const std::string &key) const
+{
+	return this->shaping_cache[key];
+}
+
+void FontCache::insert_shaped_text(const std::string &key, const ShapedText &shaped)
+{
+	size_t cost = sizeof(ShapedText) + key.size() + shaped.glyphs.size() * sizeof(ShapedText::Glyph);
+	this->shaping_cache.insert(key, new ShapedText(shaped), cost);
 }
 
 void FontCache::init_pattern(FcPattern *pattern) const
@@ -283,7 +356,7 @@ void FontCache::init_pattern(FcPattern *pattern) const
 	FcPatternAdd(pattern, FC_SCALABLE, true_value, true);
 }
 
-FT_Face FontCache::find_face_fontconfig(const std::string &font) const
+bool FontCache::find_font_file(const std::string &font, std::string &file, int &index) const
 {
 	FcResult result;
 
@@ -294,22 +367,31 @@ FT_Face FontCache::find_face_fontconfig(const std::string &font) const
 	FcDefaultSubstitute(pattern);
 
 	FcPattern *match = FcFontMatch(this->config, pattern, &result);
+	FcPatternDestroy(pattern);
+	if (!match) {
+		return false;
+	}
 
+	bool found = false;
 	FcValue file_value;
-	if (FcPatternGet(match, FC_FILE, 0, &file_value) != FcResultMatch) {
-		return NULL;
+	FcValue font_index;
+	if (FcPatternGet(match, FC_FILE, 0, &file_value) == FcResultMatch &&
+			FcPatternGet(match, FC_INDEX, 0, &font_index) == FcResultMatch) {
+		file = (const char *) file_value.u.s;
+		index = font_index.u.i;
+		found = true;
 	}
+	FcPatternDestroy(match);
+	return found;
+}
 
-	FcValue font_index;
-	if (FcPatternGet(match, FC_INDEX, 0, &font_index)) {
+FT_Face FontCache::open_face(const std::string &file, int index) const
+{
+	FT_Face face;
+	FT_Error error = FT_New_Face(this->library, file.c_str(), index, &face);
+	if (error) {
 		return NULL;
 	}
-	
-	FT_Face face;
-	FT_Error error = FT_New_Face(this->library, (const char *) file_value.u.s, font_index.u.i, &face);
-
-	FcPatternDestroy(pattern);
-	FcPatternDestroy(match);
 
 	for (int a = 0; a < face->num_charmaps; a++) {
 		FT_CharMap charmap = face->charmaps[a];
@@ -338,7 +420,7 @@ FT_Face FontCache::find_face_fontconfig(const std::string &font) const
 			PRINTB("Warning: Could not select a char map for font %s/%s", face->family_name % face->style_name);
 	}
 	
-	return error ? NULL : face;
+	return face;
 }
 
 bool FontCache::try_charmap(FT_Face face, int platform_id, int encoding_id) const
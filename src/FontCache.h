@@ -26,6 +26,7 @@
 #pragma once
 
 #include <map>
+#include <list>
 #include <string>
 #include <iostream>
 
@@ -42,6 +43,8 @@
 #include <hb.h>
 #include <hb-ft.h>
 
+#include "cache.h"
+
 class FontInfo {
 public:
     FontInfo(const std::string &family, const std::string &style, const std::string &file);
@@ -59,41 +62,81 @@ private:
 
 typedef std::vector<FontInfo> FontInfoList;
 
+/*!
+	A shaped run of text, as returned by HarfBuzz. Positions are in the
+	units of the font's HarfBuzz scale (26.6 fixed point).
+*/
+class ShapedText {
+public:
+    struct Glyph {
+        unsigned int codepoint;
+        int x_offset, y_offset;
+        int x_advance, y_advance;
+    };
+    std::vector<Glyph> glyphs;
+    bool horizontal;
+};
+
+/*!
+	Caches opened fonts and the results of font related lookups.
+
+	Faces are kept in a least recently used list bounded by the total size of
+	their font files (see set_max_size()). Each face owns a long-lived
+	HarfBuzz font. Font name to font file lookups through fontconfig are
+	memoized, as are shaping results.
+*/
 class FontCache {
 public:
     const static std::string DEFAULT_FONT;
-    const static unsigned int MAX_NR_OF_CACHE_ENTRIES = 3;
+    const static size_t DEFAULT_MAX_SIZE = 64*1024*1024;
     
     FontCache();
     virtual ~FontCache();
 
     bool is_init_ok() const;
     FT_Face get_font(const std::string &font);
+    hb_font_t *get_hb_font(FT_Face face) const;
     bool is_windows_symbol_font(const FT_Face &face) const;
     void register_font_file(const std::string &path);
     void clear();
     FontInfoList *list_fonts() const;
+
+    const ShapedText *get_shaped_text(const std::string &key) const;
+    void insert_shaped_text(const std::string &key, const ShapedText &shaped);
+
+    static size_t max_size();
+    static void set_max_size(size_t limit);
     
     static FontCache *instance();
 private:
-    typedef std::pair<FT_Face, time_t> cache_entry_t;
-    typedef std::map<std::string, cache_entry_t> cache_t;
+    struct face_entry_t {
+        FT_Face face;
+        hb_font_t *hb_font;
+        size_t size;
+    };
+    typedef std::map<std::string, face_entry_t> face_cache_t;
+    typedef std::map<std::string, std::string> lookup_cache_t;
 
     static FontCache *self;
+    static size_t max_cache_size;
     
     bool init_ok;
-    cache_t cache;
+    face_cache_t cache;
+    std::list<std::string> lru; // Keys of cache, most recently used first
+    size_t total_size;
+    lookup_cache_t lookup_cache;
+    Cache<std::string, ShapedText> shaping_cache;
     FcConfig *config;
     FT_Library library;
 
+    void touch(const std::string &key);
     void check_cleanup();
     void dump_cache(const std::string &info);
     
     void add_font_dir(const std::string &path);
     void init_pattern(FcPattern *pattern) const;
     
-    FT_Face find_face(const std::string &font) const;
-    FT_Face find_face_fontconfig(const std::string &font) const;
+    bool find_font_file(const std::string &font, std::string &file, int &index) const;
+    FT_Face open_face(const std::string &file, int index) const;
     bool try_charmap(FT_Face face, int platform_id, int encoding_id) const;
 };
-
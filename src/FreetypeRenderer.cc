@@ -27,6 +27,8 @@
 #include <stdio.h>
 
 #include <iostream>
+#include <sstream>
+#include <iomanip>
 
 #include <glib.h>
 
@@ -37,6 +39,7 @@
 #include "FontCache.h"
 #include "DrawingCallback.h"
 #include "FreetypeRenderer.h"
+#include "clipper-utils.h"
 
 #include FT_OUTLINE_H
 
@@ -122,35 +125,99 @@ double FreetypeRenderer::calc_y_offset(std::string valign, double ascend, double
 	}
 }
 
-std::vector<const Geometry *> FreetypeRenderer::render(const FreetypeRenderer::Params &params) const
+/*!
+	Fetches the outline of a glyph of the given face from the glyph cache.
+	On a cache miss the glyph is loaded through FreeType, flattened with
+	params.segments segments per curve and sanitized before it's cached.
+	The face must already be set to params.size.
+ */
+bool FreetypeRenderer::load_glyph(FT_Face face, FT_UInt glyph_index, unsigned int idx,
+																	const FreetypeRenderer::Params &params, GlyphCache::Glyph &glyph) const
 {
-	FT_Face face;
-	FT_Error error;
-	DrawingCallback callback(params.segments);
-	
-	FontCache *cache = FontCache::instance();
-	if (!cache->is_init_ok()) {
-		return std::vector<const Geometry *>();
+	GlyphCache *cache = GlyphCache::instance();
+	std::string key = GlyphCache::makeKey(face->family_name ? face->family_name : "",
+																				face->style_name ? face->style_name : "",
+																				glyph_index, params.size, params.segments);
+	if (cache->contains(key)) {
+		glyph = cache->get(key);
+		return true;
 	}
 
-	face = cache->get_font(params.font);
-	if (face == NULL) {
-		return std::vector<const Geometry *>();
+	FT_Error error = FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT);
+	if (error) {
+		PRINTB("Could not load glyph %u for char at index %u in text '%s'", glyph_index % idx % params.text);
+		return false;
 	}
-	
-	error = FT_Set_Char_Size(face, 0, params.size * scale, 100, 100);
+
+	FT_Glyph ft_glyph;
+	error = FT_Get_Glyph(face->glyph, &ft_glyph);
 	if (error) {
-		PRINTB("Can't set font size for font %s", params.font);
-		return std::vector<const Geometry *>();
+		PRINTB("Could not get glyph %u for char at index %u in text '%s'", glyph_index % idx % params.text);
+		return false;
 	}
-	
-	hb_font_t *hb_ft_font = hb_ft_font_create(face, NULL);
+
+	FT_BBox bbox;
+	FT_Glyph_Get_CBox(ft_glyph, FT_GLYPH_BBOX_GRIDFIT, &bbox);
+	glyph.xmin = bbox.xMin / 64.0 / 16.0;
+	glyph.ymin = bbox.yMin / 64.0 / 16.0;
+	glyph.xmax = bbox.xMax / 64.0 / 16.0;
+	glyph.ymax = bbox.yMax / 64.0 / 16.0;
+
+	DrawingCallback callback(params.segments);
+	callback.start_glyph();
+	FT_Outline outline = reinterpret_cast<FT_OutlineGlyph>(ft_glyph)->outline;
+	FT_Outline_Decompose(&outline, &funcs, &callback);
+	callback.finish_glyph();
+	FT_Done_Glyph(ft_glyph);
+
+	std::vector<const Geometry *> result = callback.get_result();
+	if (!result.empty()) {
+		const Polygon2d *polygon = dynamic_cast<const Polygon2d *>(result[0]);
+		assert(polygon);
+		Polygon2d *sanitized = ClipperUtils::sanitize(*polygon);
+		if (!sanitized->isEmpty()) glyph.outline.reset(sanitized);
+		else delete sanitized;
+		delete polygon;
+	}
+
+	cache->insert(key, glyph);
+	return true;
+}
+
+/*!
+	Shapes params.text with the given face, which must already be set to
+	params.size. Results are cached in the FontCache, keyed by face, size,
+	text, direction, script and language.
+ */
+bool FreetypeRenderer::shape_text(FT_Face face, const FreetypeRenderer::Params &params, ShapedText &shaped) const
+{
+	FontCache *cache = FontCache::instance();
+	std::stringstream key;
+	key << std::setprecision(17)
+			<< (face->family_name ? face->family_name : "") << "|"
+			<< (face->style_name ? face->style_name : "") << "|"
+			<< params.size << "|" << params.direction << "|"
+			<< params.script << "|" << params.language << "|" << params.text;
+	if (const ShapedText *cached = cache->get_shaped_text(key.str())) {
+		shaped = *cached;
+		return true;
+	}
+
+	hb_font_t *hb_ft_font = cache->get_hb_font(face);
+	if (!hb_ft_font) {
+		return false;
+	}
+	// The HarfBuzz font is shared between sizes, so update its scale the same
+	// way hb_ft_font_create() initializes it.
+	hb_font_set_scale(hb_ft_font,
+										(int) (((uint64_t) face->size->metrics.x_scale * (uint64_t) face->units_per_EM + (1<<15)) >> 16),
+										(int) (((uint64_t) face->size->metrics.y_scale * (uint64_t) face->units_per_EM + (1<<15)) >> 16));
 
 	hb_buffer_t *hb_buf = hb_buffer_create();
 	hb_buffer_set_direction(hb_buf, hb_direction_from_string(params.direction.c_str(), -1));
 	hb_buffer_set_script(hb_buf, hb_script_from_string(params.script.c_str(), -1));
 	hb_buffer_set_language(hb_buf, hb_language_from_string(params.language.c_str(), -1));
-	if (FontCache::instance()->is_windows_symbol_font(face)) {
+	if (cache->is_windows_symbol_font(face)) {
 		// Special handling for symbol fonts like Webdings.
 		// see http://www.microsoft.com/typography/otspec/recom.htm
 		//
@@ -179,43 +246,72 @@ std::vector<const Geometry *> FreetypeRenderer::render(const FreetypeRenderer::P
 	hb_shape(hb_ft_font, hb_buf, NULL, 0);
 	
 	unsigned int glyph_count;
-        hb_glyph_info_t *glyph_info = hb_buffer_get_glyph_infos(hb_buf, &glyph_count);
-        hb_glyph_position_t *glyph_pos = hb_buffer_get_glyph_positions(hb_buf, &glyph_count);	
-	
-	GlyphArray glyph_array;
+	hb_glyph_info_t *glyph_info = hb_buffer_get_glyph_infos(hb_buf, &glyph_count);
+	hb_glyph_position_t *glyph_pos = hb_buffer_get_glyph_positions(hb_buf, &glyph_count);
+
+	shaped.horizontal = HB_DIRECTION_IS_HORIZONTAL(hb_buffer_get_direction(hb_buf));
+	shaped.glyphs.resize(glyph_count);
 	for (unsigned int idx = 0;idx < glyph_count;idx++) {
-		FT_UInt glyph_index = glyph_info[idx].codepoint;
-		error = FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT);
-		if (error) {
-			PRINTB("Could not load glyph %u for char at index %u in text '%s'", glyph_index % idx % params.text);
-			continue;
-		}
+		ShapedText::Glyph &glyph = shaped.glyphs[idx];
+		glyph.codepoint = glyph_info[idx].codepoint;
+		glyph.x_offset = glyph_pos[idx].x_offset;
+		glyph.y_offset = glyph_pos[idx].y_offset;
+		glyph.x_advance = glyph_pos[idx].x_advance;
+		glyph.y_advance = glyph_pos[idx].y_advance;
+	}
+	hb_buffer_destroy(hb_buf);
 
-		FT_Glyph glyph;
-		error = FT_Get_Glyph(face->glyph, &glyph);
-		if (error) {
-			PRINTB("Could not get glyph %u for char at index %u in text '%s'", glyph_index % idx % params.text);
-			continue;
-		}
-		const GlyphData *glyph_data = new GlyphData(glyph, idx, &glyph_info[idx], &glyph_pos[idx]);
+	cache->insert_shaped_text(key.str(), shaped);
+	return true;
+}
+
+std::vector<const Geometry *> FreetypeRenderer::render(const FreetypeRenderer::Params &params) const
+{
+	FT_Face face;
+	FT_Error error;
+	
+	FontCache *cache = FontCache::instance();
+	if (!cache->is_init_ok()) {
+		return std::vector<const Geometry *>();
+	}
+
+	face = cache->get_font(params.font);
+	if (face == NULL) {
+		return std::vector<const Geometry *>();
+	}
+	
+	error = FT_Set_Char_Size(face, 0, params.size * scale, 100, 100);
+	if (error) {
+		PRINTB("Can't set font size for font %s", params.font);
+		return std::vector<const Geometry *>();
+	}
+	
+	ShapedText shaped;
+	if (!shape_text(face, params, shaped)) {
+		return std::vector<const Geometry *>();
+	}
+
+	GlyphArray glyph_array;
+	for (unsigned int idx = 0;idx < shaped.glyphs.size();idx++) {
+		GlyphCache::Glyph glyph;
+		if (!load_glyph(face, shaped.glyphs[idx].codepoint, idx, params, glyph)) continue;
+		const GlyphData *glyph_data = new GlyphData(glyph, idx, shaped.glyphs[idx]);
 		glyph_array.push_back(glyph_data);
 	}
 
 	double width = 0, ascend = 0, descend = 0;
 	for (GlyphArray::iterator it = glyph_array.begin();it != glyph_array.end();it++) {
 		const GlyphData *glyph = (*it);
+		const GlyphCache::Glyph &bbox = glyph->get_glyph();
 		
-		FT_BBox bbox;
-		FT_Glyph_Get_CBox(glyph->get_glyph(), FT_GLYPH_BBOX_GRIDFIT, &bbox);
-		
-		if (HB_DIRECTION_IS_HORIZONTAL(hb_buffer_get_direction(hb_buf))) {
-			double asc = std::max(0.0, bbox.yMax / 64.0 / 16.0);
-			double desc = std::max(0.0, -bbox.yMin / 64.0 / 16.0);
+		if (shaped.horizontal) {
+			double asc = std::max(0.0, bbox.ymax);
+			double desc = std::max(0.0, -bbox.ymin);
 			width += glyph->get_x_advance() * params.spacing;
 			ascend = std::max(ascend, asc);
 			descend = std::max(descend, desc);
 		} else {
-			double w_bbox = (bbox.xMax - bbox.xMin) / 64.0 / 16.0;
+			double w_bbox = bbox.xmax - bbox.xmin;
 			width = std::max(width, w_bbox);
 			ascend += glyph->get_y_advance() * params.spacing;
 		}
@@ -224,22 +320,20 @@ std::vector<const Geometry *> FreetypeRenderer::render(const FreetypeRenderer::P
 	double x_offset = calc_x_offset(params.halign, width);
 	double y_offset = calc_y_offset(params.valign, ascend, descend);
 
+	// Place copies of the cached glyph outlines along the shaped positions
+	std::vector<const Geometry *> result;
+	Vector2d advance(0, 0);
 	for (GlyphArray::iterator it = glyph_array.begin();it != glyph_array.end();it++) {
 		const GlyphData *glyph = (*it);
-		
-		callback.start_glyph();
-		callback.set_glyph_offset(x_offset + glyph->get_x_offset(), y_offset + glyph->get_y_offset());
-		FT_Outline outline = reinterpret_cast<FT_OutlineGlyph>(glyph->get_glyph())->outline;
-		FT_Outline_Decompose(&outline, &funcs, &callback);
-
-		double adv_x  = glyph->get_x_advance() * params.spacing;
-		double adv_y  = glyph->get_y_advance() * params.spacing;
-		callback.add_glyph_advance(adv_x, adv_y);
-		callback.finish_glyph();
+		const shared_ptr<const Polygon2d> &outline = glyph->get_glyph().outline;
+		if (outline) {
+			Polygon2d *polygon = new Polygon2d(*outline);
+			Vector2d pos = advance + Vector2d(x_offset + glyph->get_x_offset(), y_offset + glyph->get_y_offset());
+			polygon->transform(Transform2d(Eigen::Translation2d(pos)));
+			result.push_back(polygon);
+		}
+		advance += Vector2d(glyph->get_x_advance(), glyph->get_y_advance()) * params.spacing;
 	}
 
-	hb_buffer_destroy(hb_buf);
-        hb_font_destroy(hb_ft_font);
-	
-	return callback.get_result();
+	return result;
 }
@@ -34,6 +34,9 @@
 #include FT_FREETYPE_H
 #include FT_GLYPH_H
 
+#include "GlyphCache.h"
+#include "FontCache.h"
+
 class FreetypeRenderer {
 public:
     class Params {
@@ -109,23 +112,21 @@ private:
     
     class GlyphData {
     public:
-        GlyphData(FT_Glyph glyph, unsigned int idx, hb_glyph_info_t *glyph_info, hb_glyph_position_t *glyph_pos) : glyph(glyph), idx(idx), glyph_pos(glyph_pos), glyph_info(glyph_info) {}
+        GlyphData(const GlyphCache::Glyph &glyph, unsigned int idx, const ShapedText::Glyph &glyph_pos) : glyph(glyph), idx(idx), glyph_pos(glyph_pos) {}
         unsigned int get_idx() const { return idx; };
-        FT_Glyph get_glyph() const { return glyph; };
-        double get_x_offset() const { return glyph_pos->x_offset / 64.0 / 16.0; };
-        double get_y_offset() const { return glyph_pos->y_offset / 64.0 / 16.0; };
-        double get_x_advance() const { return glyph_pos->x_advance / 64.0 / 16.0; };
-        double get_y_advance() const { return glyph_pos->y_advance / 64.0 / 16.0; };
+        const GlyphCache::Glyph &get_glyph() const { return glyph; };
+        double get_x_offset() const { return glyph_pos.x_offset / 64.0 / 16.0; };
+        double get_y_offset() const { return glyph_pos.y_offset / 64.0 / 16.0; };
+        double get_x_advance() const { return glyph_pos.x_advance / 64.0 / 16.0; };
+        double get_y_advance() const { return glyph_pos.y_advance / 64.0 / 16.0; };
     private:
-        FT_Glyph glyph;
+        GlyphCache::Glyph glyph;
         unsigned int idx;
-        hb_glyph_position_t *glyph_pos;
-        hb_glyph_info_t *glyph_info;
+        ShapedText::Glyph glyph_pos;
     };
 
     struct done_glyph : public std::unary_function<const GlyphData *, void> {
         void operator() (const GlyphData *glyph_data) {
-            FT_Done_Glyph(glyph_data->get_glyph());
             delete glyph_data;
         }
     };
@@ -137,6 +138,8 @@ private:
         }
     };
 
+    bool shape_text(FT_Face face, const FreetypeRenderer::Params &params, class ShapedText &shaped) const;
+    bool load_glyph(FT_Face face, FT_UInt glyph_index, unsigned int idx, const FreetypeRenderer::Params &params, GlyphCache::Glyph &glyph) const;
     double calc_x_offset(std::string halign, double width) const;
     double calc_y_offset(std::string valign, double ascend, double descend) const;
     
@@ -28,6 +28,8 @@
 
 #include <algorithm>
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 
 #include <CGAL/convex_hull_2.h>
 #include <CGAL/Point_2.h>
@@ -458,6 +460,30 @@ Response GeometryEvaluator::visit(State &state, const LeafNode &node)
 	return PruneTraversal;
 }
 
+static bool compare_min_x(const BoundingBox &a, const BoundingBox &b)
+{
+	return a.min()[0] < b.min()[0];
+}
+
+/*!
+	Returns true if no two of the given polygons have overlapping bounding
+	boxes. Touching boxes count as overlapping.
+*/
+static bool have_disjoint_bounding_boxes(const std::vector<const Polygon2d *> &polygons)
+{
+	std::vector<BoundingBox> boxes;
+	BOOST_FOREACH(const Polygon2d *polygon, polygons) {
+		boxes.push_back(polygon->getBoundingBox());
+	}
+	std::sort(boxes.begin(), boxes.end(), compare_min_x);
+	for (size_t i=0;i<boxes.size();i++) {
+		for (size_t j=i+1;j<boxes.size() && boxes[j].min()[0] <= boxes[i].max()[0];j++) {
+			if (boxes[j].min()[1] <= boxes[i].max()[1] && boxes[i].min()[1] <= boxes[j].max()[1]) return false;
+		}
+	}
+	return true;
+}
+
 Response GeometryEvaluator::visit(State &state, const TextNode &node)
 {
 	if (state.isPrefix()) {
@@ -470,7 +496,22 @@ Response GeometryEvaluator::visit(State &state, const TextNode &node)
 				assert(polygon);
 				polygonlist.push_back(polygon);
 			}
-			geom.reset(ClipperUtils::apply(polygonlist, ClipperLib::ctUnion));
+			// Glyphs come sanitized from the glyph cache; as long as they don't
+			// overlap, their union is just the collection of their outlines.
+			if (have_disjoint_bounding_boxes(polygonlist)) {
+				Polygon2d *result = new Polygon2d;
+				BOOST_FOREACH(const Polygon2d *polygon, polygonlist) {
+					BOOST_FOREACH(const Outline2d &outline, polygon->outlines()) {
+						result->addOutline(outline);
+					}
+				}
+				result->setSanitized(true);
+				geom.reset(result);
+			}
+			else {
+				geom.reset(ClipperUtils::apply(polygonlist, ClipperLib::ctUnion));
+			}
+			BOOST_FOREACH(const Geometry *geometry, geometrylist) delete geometry;
 		}
 		else geom = GeometryCache::instance()->get(this->tree.getIdString(node));
 		addToParent(state, node, geom);
@@ -580,50 +621,82 @@ static void translate_PolySet(PolySet &ps, const Vector3d &translation)
 	}
 }
 
-static void add_slice(PolySet *ps, const Polygon2d &poly, 
-											double rot1, double rot2, 
-											double h1, double h2, 
-											const Vector2d &scale1,
-											const Vector2d &scale2)
+/*!
+	Transforms all vertices of poly to the given slice boundary (0..slices),
+	writing them in outline order into ring.
+*/
+static void fill_extrude_ring(std::vector<Vector3d> &ring, const Polygon2d &poly,
+															const LinearExtrudeNode &node, double h1, double h2, size_t j)
 {
-	Eigen::Affine2d trans1(Eigen::Scaling(scale1) * Eigen::Rotation2D<double>(-rot1*M_PI/180));
-	Eigen::Affine2d trans2(Eigen::Scaling(scale2) * Eigen::Rotation2D<double>(-rot2*M_PI/180));
-	
-	bool splitfirst = sin((rot1 - rot2)*M_PI/180) > 0.0;
+	double rot = node.twist*j / node.slices;
+	double height = h1 + (h2-h1)*j / node.slices;
+	Vector2d scale(1 - (1-node.scale_x)*j / node.slices,
+								 1 - (1-node.scale_y)*j / node.slices);
+	Eigen::Affine2d trans(Eigen::Scaling(scale) * Eigen::Rotation2D<double>(-rot*M_PI/180));
+
+	size_t k = 0;
 	BOOST_FOREACH(const Outline2d &o, poly.outlines()) {
-		Vector2d prev1 = trans1 * o.vertices[0];
-		Vector2d prev2 = trans2 * o.vertices[0];
-		for (size_t i=1;i<=o.vertices.size();i++) {
-			Vector2d curr1 = trans1 * o.vertices[i % o.vertices.size()];
-			Vector2d curr2 = trans2 * o.vertices[i % o.vertices.size()];
-			ps->append_poly();
-			
-			// Make sure to split negative outlines correctly
-			if (splitfirst xor !o.positive) {
-				ps->insert_vertex(prev1[0], prev1[1], h1);
-				ps->insert_vertex(curr2[0], curr2[1], h2);
-				ps->insert_vertex(curr1[0], curr1[1], h1);
-				if (scale2[0] > 0 || scale2[1] > 0) {
-					ps->append_poly();
-					ps->insert_vertex(curr2[0], curr2[1], h2);
-					ps->insert_vertex(prev1[0], prev1[1], h1);
-					ps->insert_vertex(prev2[0], prev2[1], h2);
+		BOOST_FOREACH(const Vector2d &v, o.vertices) {
+			Vector2d t = trans * v;
+			ring[k++] = Vector3d(t[0], t[1], height);
+		}
+	}
+}
+
+// Number of side triangles per edge in slice j; the top of the last slice may be collapsed
+static size_t triangles_per_edge(const LinearExtrudeNode &node, size_t j)
+{
+	return (1 - (1-node.scale_x)*(j+1) / node.slices > 0 ||
+					1 - (1-node.scale_y)*(j+1) / node.slices > 0) ? 2 : 1;
+}
+
+/*!
+	Writes the side triangles of slices [first, last) into their preallocated
+	slots starting at polygons. Each slice boundary ring is transformed once
+	and its vertices are shared by the triangles of both adjacent slices.
+*/
+static void fill_extrude_slices(PolySet::Polygon *polygons, const Polygon2d &poly,
+																const LinearExtrudeNode &node, double h1, double h2,
+																size_t numvertices, size_t first, size_t last)
+{
+	std::vector<Vector3d> ring1(numvertices), ring2(numvertices);
+	fill_extrude_ring(ring1, poly, node, h1, h2, first);
+
+	PolySet::Polygon *p = polygons;
+	for (size_t j = first; j < last; j++) {
+		fill_extrude_ring(ring2, poly, node, h1, h2, j+1);
+
+		double rot1 = node.twist*j / node.slices;
+		double rot2 = node.twist*(j+1) / node.slices;
+		bool splitfirst = sin((rot1 - rot2)*M_PI/180) > 0.0;
+		bool hastop = triangles_per_edge(node, j) == 2;
+
+		size_t offset = 0;
+		BOOST_FOREACH(const Outline2d &o, poly.outlines()) {
+			size_t n = o.vertices.size();
+			for (size_t i=1;i<=n;i++) {
+				const Vector3d &prev1 = ring1[offset + i-1];
+				const Vector3d &prev2 = ring2[offset + i-1];
+				const Vector3d &curr1 = ring1[offset + i%n];
+				const Vector3d &curr2 = ring2[offset + i%n];
+
+				// Make sure to split negative outlines correctly
+				if (splitfirst xor !o.positive) {
+					p->reserve(3); p->push_back(curr1); p->push_back(curr2); p->push_back(prev1); p++;
+					if (hastop) {
+						p->reserve(3); p->push_back(prev2); p->push_back(prev1); p->push_back(curr2); p++;
+					}
 				}
-			}
-			else {
-				ps->insert_vertex(prev1[0], prev1[1], h1);
-				ps->insert_vertex(prev2[0], prev2[1], h2);
-				ps->insert_vertex(curr1[0], curr1[1], h1);
-				if (scale2[0] > 0 || scale2[1] > 0) {
-					ps->append_poly();
-					ps->insert_vertex(prev2[0], prev2[1], h2);
-					ps->insert_vertex(curr2[0], curr2[1], h2);
-					ps->insert_vertex(curr1[0], curr1[1], h1);
+				else {
+					p->reserve(3); p->push_back(curr1); p->push_back(prev2); p->push_back(prev1); p++;
+					if (hastop) {
+						p->reserve(3); p->push_back(curr1); p->push_back(curr2); p->push_back(prev2); p++;
+					}
 				}
 			}
-			prev1 = curr1;
-			prev2 = curr2;
+			offset += n;
 		}
+		ring1.swap(ring2);
 	}
 }
 
@@ -668,18 +741,37 @@ static Geometry *extrudePolygon(const LinearExtrudeNode &node, const Polygon2d &
 		ps->append(*ps_top);
 		delete ps_top;
 	}
-    size_t slices = node.slices;
-
-	for (unsigned int j = 0; j < slices; j++) {
-		double rot1 = node.twist*j / slices;
-		double rot2 = node.twist*(j+1) / slices;
-		double height1 = h1 + (h2-h1)*j / slices;
-		double height2 = h1 + (h2-h1)*(j+1) / slices;
-		Vector2d scale1(1 - (1-node.scale_x)*j / slices,
-										1 - (1-node.scale_y)*j / slices);
-		Vector2d scale2(1 - (1-node.scale_x)*(j+1) / slices,
-										1 - (1-node.scale_y)*(j+1) / slices);
-		add_slice(ps, poly, rot1, rot2, height1, height2, scale1, scale2);
+	size_t slices = node.slices;
+	size_t numvertices = 0;
+	BOOST_FOREACH(const Outline2d &o, poly.outlines()) numvertices += o.vertices.size();
+	if (slices == 0 || numvertices == 0) return ps;
+
+	// Side triangles are written into preallocated slots; slice_start[j] is
+	// the index of the first triangle of slice j.
+	std::vector<size_t> slice_start(slices + 1);
+	slice_start[0] = ps->polygons.size();
+	for (size_t j = 0; j < slices; j++) {
+		slice_start[j+1] = slice_start[j] + numvertices * triangles_per_edge(node, j);
+	}
+	ps->polygons.resize(slice_start[slices]);
+
+	// Slices are independent, so large extrusions are split across threads
+	unsigned int nthreads = std::max(1u, boost::thread::hardware_concurrency());
+	if (slice_start[slices] - slice_start[0] < 65536) nthreads = 1;
+	nthreads = std::min(nthreads, (unsigned int)slices);
+	if (nthreads == 1) {
+		fill_extrude_slices(&ps->polygons[slice_start[0]], poly, node, h1, h2, numvertices, 0, slices);
+	}
+	else {
+		boost::thread_group threads;
+		for (unsigned int t = 0; t < nthreads; t++) {
+			size_t first = (slices * t) / nthreads;
+			size_t last = (slices * (t+1)) / nthreads;
+			threads.create_thread(boost::bind(fill_extrude_slices, &ps->polygons[slice_start[first]],
+																				boost::cref(poly), boost::cref(node), h1, h2,
+																				numvertices, first, last));
+		}
+		threads.join_all();
 	}
 
 	return ps;
@@ -724,11 +816,11 @@ Response GeometryEvaluator::visit(State &state, const LinearExtrudeNode &node)
 	return ContinueTraversal;
 }
 
-static void fill_ring(std::vector<Vector3d> &ring, const Outline2d &o, double a)
+static void fill_ring(std::vector<Vector3d> &ring, const Outline2d &o, double sina, double cosa)
 {
 	for (unsigned int i=0;i<o.vertices.size();i++) {
-		ring[i][0] = o.vertices[i][0] * sin(a);
-		ring[i][1] = o.vertices[i][0] * cos(a);
+		ring[i][0] = o.vertices[i][0] * sina;
+		ring[i][1] = o.vertices[i][0] * cosa;
 		ring[i][2] = o.vertices[i][1];
 	}
 }
@@ -737,25 +829,22 @@ static void fill_ring(std::vector<Vector3d> &ring, const Outline2d &o, double a)
 	Input to extrude should be clean. This means non-intersecting, correct winding order
 	etc., the input coming from a library like Clipper.
 
-	FIXME: We should handle some common corner cases better:
-  o 2D polygon having an edge being on the Y axis:
-	  In this case, we don't need to generate geometry involving this edge as it
-		will be an internal edge.
-  o 2D polygon having a vertex touching the Y axis:
-    This is more complex as the resulting geometry will (may?) be nonmanifold.
-		In any case, the previous case is a specialization of this, so the following
-		should be handled for both cases:
-		Since the ring associated with this vertex will have a radius of zero, it will
-		collapse to one vertex. Any quad using this ring will be collapsed to a triangle.
-
-	Currently, we generate a lot of zero-area triangles
+	The sin/cos of each fragment angle is computed once per outline, and
+	each ring is computed once and shared by the two adjacent fragments.
 
+	Vertices on the Y axis collapse to a single point on the rotation axis:
+	  o For an edge with one vertex on the axis, only the triangle of each
+	    quad which doesn't use the collapsed ring is emitted.
+	  o Edges lying on the axis are internal and generate no geometry.
+	This avoids the zero-area triangles which used to be emitted for such
+	profiles.
 */
 static Geometry *rotatePolygon(const RotateExtrudeNode &node, const Polygon2d &poly)
 {
 	PolySet *ps = new PolySet(3);
 	ps->setConvexity(node.convexity);
 
+	std::vector<double> sintable, costable;
 	BOOST_FOREACH(const Outline2d &o, poly.outlines()) {
 		double min_x = 0;
 		double max_x = 0;
@@ -771,24 +860,51 @@ static Geometry *rotatePolygon(const RotateExtrudeNode &node, const Polygon2d &p
 		}
 		int fragments = Calc::get_fragments_from_r(max_x - min_x, node.fn, node.fs, node.fa);
 
+		if (sintable.size() != size_t(fragments)) {
+			sintable.resize(fragments);
+			costable.resize(fragments);
+			for (int j = 0; j < fragments; j++) {
+				double a = (j*2*M_PI) / fragments - M_PI/2; // start on the X axis
+				sintable[j] = sin(a);
+				costable[j] = cos(a);
+			}
+		}
+
+		size_t n = o.vertices.size();
+		std::vector<bool> onaxis(n);
+		size_t numtriangles = 0;
+		for (size_t i=0;i<n;i++) onaxis[i] = o.vertices[i][0] == 0;
+		for (size_t i=0;i<n;i++) numtriangles += !onaxis[i] + !onaxis[(i+1)%n];
+		ps->polygons.reserve(ps->polygons.size() + numtriangles * fragments);
+
 		std::vector<Vector3d> rings[2];
-		rings[0].resize(o.vertices.size());
-		rings[1].resize(o.vertices.size());
+		rings[0].resize(n);
+		rings[1].resize(n);
 
-		fill_ring(rings[0], o, -M_PI/2); // first ring
+		fill_ring(rings[0], o, sintable[0], costable[0]); // first ring
 		for (int j = 0; j < fragments; j++) {
-			double a = ((j+1)%fragments*2*M_PI) / fragments - M_PI/2; // start on the X axis
-			fill_ring(rings[(j+1)%2], o, a);
-
-			for (size_t i=0;i<o.vertices.size();i++) {
-				ps->append_poly();
-				ps->insert_vertex(rings[j%2][i]);
-				ps->insert_vertex(rings[(j+1)%2][(i+1)%o.vertices.size()]);
-				ps->insert_vertex(rings[j%2][(i+1)%o.vertices.size()]);
-				ps->append_poly();
-				ps->insert_vertex(rings[j%2][i]);
-				ps->insert_vertex(rings[(j+1)%2][i]);
-				ps->insert_vertex(rings[(j+1)%2][(i+1)%o.vertices.size()]);
+			const std::vector<Vector3d> &ring1 = rings[j%2];
+			std::vector<Vector3d> &ring2 = rings[(j+1)%2];
+			fill_ring(ring2, o, sintable[(j+1)%fragments], costable[(j+1)%fragments]);
+
+			for (size_t i=0;i<n;i++) {
+				size_t next = (i+1)%n;
+				if (!onaxis[next]) {
+					ps->polygons.push_back(PolySet::Polygon());
+					PolySet::Polygon &p = ps->polygons.back();
+					p.reserve(3);
+					p.push_back(ring1[next]);
+					p.push_back(ring2[next]);
+					p.push_back(ring1[i]);
+				}
+				if (!onaxis[i]) {
+					ps->polygons.push_back(PolySet::Polygon());
+					PolySet::Polygon &p = ps->polygons.back();
+					p.reserve(3);
+					p.push_back(ring2[next]);
+					p.push_back(ring2[i]);
+					p.push_back(ring1[i]);
+				}
 			}
 		}
 	}
@@ -0,0 +1,43 @@
+#include "GlyphCache.h"
+#include "printutils.h"
+
+#include <sstream>
+#include <iomanip>
+
+GlyphCache *GlyphCache::inst = NULL;
+
+std::string GlyphCache::makeKey(const std::string &family, const std::string &style,
+																unsigned int glyph_index, double size, double segments)
+{
+	std::stringstream key;
+	key << std::setprecision(17) << family << "|" << style << "|"
+			<< glyph_index << "|" << size << "|" << segments;
+	return key.str();
+}
+
+const GlyphCache::Glyph &GlyphCache::get(const std::string &id) const
+{
+	return *this->cache[id];
+}
+
+bool GlyphCache::insert(const std::string &id, const Glyph &glyph)
+{
+	size_t cost = sizeof(Glyph) + id.size() + (glyph.outline ? glyph.outline->memsize() : 0);
+	return this->cache.insert(id, new Glyph(glyph), cost);
+}
+
+size_t GlyphCache::maxSize() const
+{
+	return this->cache.maxCost();
+}
+
+void GlyphCache::setMaxSize(size_t limit)
+{
+	this->cache.setMaxCost(limit);
+}
+
+void GlyphCache::print()
+{
+	PRINTB("Glyphs in cache: %d", this->cache.size());
+	PRINTB("Glyph cache size in bytes: %d", this->cache.totalCost());
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "cache.h"
+#include "memory.h"
+#include "Polygon2d.h"
+
+/*!
+	Caches flattened and sanitized glyph outlines, so text() only has to go
+	through FreeType once per distinct glyph. The key identifies the face,
+	the glyph index, the font size and the number of curve segments; see
+	makeKey(). Outlines are stored relative to the glyph origin together
+	with the grid-fitted control box used for text alignment.
+*/
+class GlyphCache
+{
+public:	
+	GlyphCache(size_t memorylimit = 16*1024*1024) : cache(memorylimit) {}
+
+	static GlyphCache *instance() { if (!inst) inst = new GlyphCache; return inst; }
+
+	static std::string makeKey(const std::string &family, const std::string &style,
+														 unsigned int glyph_index, double size, double segments);
+
+	struct Glyph {
+		shared_ptr<const Polygon2d> outline;
+		double xmin, ymin, xmax, ymax; // Control box in font units
+	};
+
+	bool contains(const std::string &id) const { return this->cache.contains(id); }
+	const Glyph &get(const std::string &id) const;
+	bool insert(const std::string &id, const Glyph &glyph);
+	size_t maxSize() const;
+	void setMaxSize(size_t limit);
+	void clear() { cache.clear(); }
+	void print();
+
+private:
+	static GlyphCache *inst;
+
+	Cache<std::string, Glyph> cache;
+};
@@ -0,0 +1,81 @@
+#include "ImportCache.h"
+#include "printutils.h"
+
+#include <sstream>
+#include <stdint.h>
+#include <boost/filesystem.hpp>
+namespace fs = boost::filesystem;
+
+ImportCache *ImportCache::inst = NULL;
+
+/*!
+	Builds a cache key from the file identity and the given import
+	parameters. A modified file gets a new key, so stale entries simply
+	age out of the cache.
+*/
+std::string ImportCache::makeKey(const std::string &filename, const std::string &params)
+{
+	std::stringstream keystream;
+	fs::path filepath(filename);
+	uintmax_t filesize = -1;
+	time_t lastwritetime = -1;
+	if (fs::exists(filepath) && fs::is_regular_file(filepath)) {
+		filesize = fs::file_size(filepath);
+		lastwritetime = fs::last_write_time(filepath);
+	}
+	keystream << filename << "|" << lastwritetime << "|" << filesize << "|" << params;
+	return keystream.str();
+}
+
+/*!
+	Returns the cached geometry, or an empty pointer if the key isn't cached.
+	Also updates the hit/miss statistics.
+*/
+shared_ptr<const Geometry> ImportCache::get(const std::string &id)
+{
+	cache_entry *entry = this->cache[id];
+	if (!entry) {
+		this->misses++;
+		return shared_ptr<const Geometry>();
+	}
+	this->hits++;
+#ifdef DEBUG
+	PRINTB("Import Cache hit: %s (%d bytes)", id.substr(0, 40) % (entry->geom ? entry->geom->memsize() : 0));
+#endif
+	return entry->geom;
+}
+
+bool ImportCache::insert(const std::string &id, const shared_ptr<const Geometry> &geom)
+{
+	bool inserted = this->cache.insert(id, new cache_entry(geom), geom ? geom->memsize() : 0);
+#ifdef DEBUG
+	if (inserted) PRINTB("Import Cache insert: %s (%d bytes)", 
+                         id.substr(0, 40) % (geom ? geom->memsize() : 0));
+	else PRINTB("Import Cache insert failed: %s (%d bytes)",
+                id.substr(0, 40) % (geom ? geom->memsize() : 0));
+#endif
+	return inserted;
+}
+
+size_t ImportCache::maxSize() const
+{
+	return this->cache.maxCost();
+}
+
+void ImportCache::setMaxSize(size_t limit)
+{
+	this->cache.setMaxCost(limit);
+}
+
+void ImportCache::clear()
+{
+	this->cache.clear();
+	this->hits = this->misses = 0;
+}
+
+void ImportCache::print()
+{
+	PRINTB("Imported files in cache: %d", this->cache.size());
+	PRINTB("Import cache size in bytes: %d", this->cache.totalCost());
+	PRINTB("Import cache hits: %d, misses: %d", this->hits % this->misses);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "cache.h"
+#include "memory.h"
+#include "Geometry.h"
+
+/*!
+	Caches the parsed result of imported files, independently of the node
+	tree. The key identifies the file (name, size and timestamp) and the
+	import parameters, so every ImportNode reading the same file with the
+	same parameters shares one entry, regardless of where it's used.
+*/
+class ImportCache
+{
+public:	
+	ImportCache(size_t memorylimit = 100*1024*1024) : cache(memorylimit), hits(0), misses(0) {}
+
+	static ImportCache *instance() { if (!inst) inst = new ImportCache; return inst; }
+
+	static std::string makeKey(const std::string &filename, const std::string &params);
+
+	bool contains(const std::string &id) const { return this->cache.contains(id); }
+	shared_ptr<const class Geometry> get(const std::string &id);
+	bool insert(const std::string &id, const shared_ptr<const Geometry> &geom);
+	size_t maxSize() const;
+	void setMaxSize(size_t limit);
+	void clear();
+	void print();
+
+private:
+	static ImportCache *inst;
+
+	struct cache_entry {
+		shared_ptr<const class Geometry> geom;
+		cache_entry(const shared_ptr<const Geometry> &geom) : geom(geom) { }
+		~cache_entry() { }
+	};
+
+	Cache<std::string, cache_entry> cache;
+	unsigned long hits;
+	unsigned long misses;
+};
@@ -17,6 +17,7 @@ enum export_type_e {
 	EXPORT_TYPE_UNKNOWN,
 	EXPORT_TYPE_STL,
 	EXPORT_TYPE_AMF,
+	EXPORT_TYPE_3MF,
 	EXPORT_TYPE_OFF
 };
 
@@ -165,6 +166,7 @@ private slots:
 	void actionExportSTL();
 	void actionExportOFF();
 	void actionExportAMF();
+	void actionExport3MF();
 	void actionExportDXF();
 	void actionExportSVG();
 	void actionExportCSG();
@@ -1,4 +1,5 @@
 #include "Polygon2d.h"
+#include "clipper-utils.h"
 #include "printutils.h"
 #include <boost/foreach.hpp>
 
@@ -12,13 +13,78 @@
 	We can store sanitized vs. unsanitized polygons. Sanitized polygons
 	will have opposite winding order for holes and is guaranteed to not
 	have intersecting geometry. Sanitization is typically done by ClipperUtils.
+
+	Polygons produced by ClipperUtils keep their integer Clipper paths, so
+	chained 2D operations can reuse them without converting back and
+	forth. The double precision outlines are only built (and cleaned) once
+	somebody asks for them, e.g. when extruding, tessellating or exporting.
 */
 
+Polygon2d::Polygon2d(const shared_ptr<const ClipperLib::Paths> &paths)
+	: sanitized(true), paths(paths), materialized(false)
+{
+}
+
+void Polygon2d::materialize() const
+{
+	if (this->materialized) return;
+	const double CLEANING_DISTANCE = 0.001 * ClipperUtils::CLIPPER_SCALE;
+
+	BOOST_FOREACH(const ClipperLib::Path &path, *this->paths) {
+		Outline2d outline;
+		// Apparently, when using offset(), clipper gets the hole status wrong
+		//outline.positive = !node->IsHole();
+		outline.positive = ClipperLib::Orientation(path);
+
+		ClipperLib::Path cleaned_path;
+		ClipperLib::CleanPolygon(path, cleaned_path, CLEANING_DISTANCE);
+
+		// CleanPolygon can in some cases reduce the polygon down to no vertices
+		if (cleaned_path.size() >= 3)  {
+			BOOST_FOREACH(const ClipperLib::IntPoint &ip, cleaned_path) {
+				Vector2d v(1.0*ip.X/ClipperUtils::CLIPPER_SCALE, 1.0*ip.Y/ClipperUtils::CLIPPER_SCALE);
+				outline.vertices.push_back(v);
+			}
+			this->theoutlines.push_back(outline);
+		}
+	}
+	this->materialized = true;
+}
+
+/*!
+	Called before modifying the outlines, since the Clipper paths would
+	no longer match them.
+*/
+void Polygon2d::discardPaths()
+{
+	materialize();
+	this->paths.reset();
+}
+
+const Polygon2d::Outlines2d &Polygon2d::outlines() const
+{
+	materialize();
+	return this->theoutlines;
+}
+
+void Polygon2d::addOutline(const Outline2d &outline)
+{
+	discardPaths();
+	this->theoutlines.push_back(outline);
+}
+
 size_t Polygon2d::memsize() const
 {
 	size_t mem = 0;
-	BOOST_FOREACH(const Outline2d &o, this->outlines()) {
-		mem += o.vertices.size() * sizeof(Vector2d) + sizeof(Outline2d);
+	if (this->paths) {
+		BOOST_FOREACH(const ClipperLib::Path &p, *this->paths) {
+			mem += p.size() * sizeof(ClipperLib::IntPoint) + sizeof(ClipperLib::Path);
+		}
+	}
+	if (this->materialized) {
+		BOOST_FOREACH(const Outline2d &o, this->theoutlines) {
+			mem += o.vertices.size() * sizeof(Vector2d) + sizeof(Outline2d);
+		}
 	}
 	mem += sizeof(Polygon2d);
 	return mem;
@@ -38,7 +104,7 @@ BoundingBox Polygon2d::getBoundingBox() const
 std::string Polygon2d::dump() const
 {
 	std::stringstream out;
-	BOOST_FOREACH(const Outline2d &o, this->theoutlines) {
+	BOOST_FOREACH(const Outline2d &o, this->outlines()) {
 		out << "contour:\n";
 		BOOST_FOREACH(const Vector2d &v, o.vertices) {
 			out << "  " << v.transpose();
@@ -50,16 +116,19 @@ std::string Polygon2d::dump() const
 
 bool Polygon2d::isEmpty() const
 {
-	return this->theoutlines.empty();
+	return this->outlines().empty();
 }
 
 void Polygon2d::transform(const Transform2d &mat)
 {
 	if (mat.matrix().determinant() == 0) {
 		PRINT("Warning: Scaling a 2D object with 0 - removing object");
+		this->paths.reset();
 		this->theoutlines.clear();
+		this->materialized = true;
 		return;
 	}
+	discardPaths();
 	BOOST_FOREACH(Outline2d &o, this->theoutlines) {
 		BOOST_FOREACH(Vector2d &v, o.vertices) {
 			v = mat * v;
@@ -93,6 +162,7 @@ void Polygon2d::resize(Vector2d newsize, const Eigen::Matrix<bool,2,1> &autosize
 }
 
 bool Polygon2d::is_convex() const {
+	materialize();
 	if (theoutlines.size() > 1) return false;
 	if (theoutlines.empty()) return true;
 
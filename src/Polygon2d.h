@@ -2,6 +2,7 @@
 
 #include "Geometry.h"
 #include "linalg.h"
+#include "polyclipping/clipper.hpp"
 #include <vector>
 
 /*!
@@ -17,7 +18,8 @@ struct Outline2d {
 class Polygon2d : public Geometry
 {
 public:
-	Polygon2d() : sanitized(false) {}
+	Polygon2d() : sanitized(false), materialized(true) {}
+	explicit Polygon2d(const shared_ptr<const ClipperLib::Paths> &paths);
 	virtual size_t memsize() const;
 	virtual BoundingBox getBoundingBox() const;
 	virtual std::string dump() const;
@@ -25,11 +27,12 @@ public:
 	virtual bool isEmpty() const;
 	virtual Geometry *copy() const { return new Polygon2d(*this); }
 
-	void addOutline(const Outline2d &outline) { this->theoutlines.push_back(outline); }
+	void addOutline(const Outline2d &outline);
 	class PolySet *tessellate() const;
 
 	typedef std::vector<Outline2d> Outlines2d;
-	const Outlines2d &outlines() const { return theoutlines; }
+	const Outlines2d &outlines() const;
+	const ClipperLib::Paths *clipperPaths() const { return this->paths.get(); }
 
 	void transform(const Transform2d &mat);
 	void resize(Vector2d newsize, const Eigen::Matrix<bool,2,1> &autosize);
@@ -38,6 +41,12 @@ public:
 	void setSanitized(bool s) { this->sanitized = s; }
 	bool is_convex() const;
 private:
-	Outlines2d theoutlines;
+	void materialize() const;
+	void discardPaths();
+
+	mutable Outlines2d theoutlines;
 	bool sanitized;
+	// Integer-coordinate contours from Clipper; outlines are built from these on demand
+	shared_ptr<const ClipperLib::Paths> paths;
+	mutable bool materialized;
 };
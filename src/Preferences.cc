@@ -32,6 +32,8 @@
 #include <QSettings>
 #include <QStatusBar>
 #include "GeometryCache.h"
+#include "ImportCache.h"
+#include "FontCache.h"
 #include "AutoUpdater.h"
 #include "feature.h"
 #ifdef ENABLE_CGAL
@@ -96,6 +98,8 @@ Preferences::Preferences(QWidget *parent) : QMainWindow(parent)
 	this->defaultmap["advanced/opencsg_show_warning"] = true;
 	this->defaultmap["advanced/enable_opencsg_opengl1x"] = true;
 	this->defaultmap["advanced/polysetCacheSize"] = uint(GeometryCache::instance()->maxSize());
+	this->defaultmap["advanced/importCacheSize"] = uint(ImportCache::instance()->maxSize());
+	this->defaultmap["advanced/fontCacheSize"] = uint(FontCache::max_size());
 #ifdef ENABLE_CGAL
 	this->defaultmap["advanced/cgalCacheSize"] = uint(CGALCache::instance()->maxSize());
 #endif
@@ -134,6 +138,8 @@ Preferences::Preferences(QWidget *parent) : QMainWindow(parent)
 	this->cgalCacheSizeEdit->setValidator(validator);
 #endif
 	this->polysetCacheSizeEdit->setValidator(validator);
+	this->importCacheSizeEdit->setValidator(validator);
+	this->fontCacheSizeEdit->setValidator(validator);
 	this->opencsgLimitEdit->setValidator(validator);
 
 	setupFeaturesPage();
@@ -359,6 +365,20 @@ void Preferences::on_polysetCacheSizeEdit_textChanged(const QString &text)
 	GeometryCache::instance()->setMaxSize(text.toULong());
 }
 
+void Preferences::on_importCacheSizeEdit_textChanged(const QString &text)
+{
+	QSettings settings;
+	settings.setValue("advanced/importCacheSize", text);
+	ImportCache::instance()->setMaxSize(text.toULong());
+}
+
+void Preferences::on_fontCacheSizeEdit_textChanged(const QString &text)
+{
+	QSettings settings;
+	settings.setValue("advanced/fontCacheSize", text);
+	FontCache::set_max_size(text.toULong());
+}
+
 void Preferences::on_opencsgLimitEdit_textChanged(const QString &text)
 {
 	QSettings settings;
@@ -464,6 +484,8 @@ void Preferences::updateGUI()
 	this->enableOpenCSGBox->setChecked(getValue("advanced/enable_opencsg_opengl1x").toBool());
 	this->cgalCacheSizeEdit->setText(getValue("advanced/cgalCacheSize").toString());
 	this->polysetCacheSizeEdit->setText(getValue("advanced/polysetCacheSize").toString());
+	this->importCacheSizeEdit->setText(getValue("advanced/importCacheSize").toString());
+	this->fontCacheSizeEdit->setText(getValue("advanced/fontCacheSize").toString());
 	this->opencsgLimitEdit->setText(getValue("advanced/openCSGLimit").toString());
 	this->forceGoldfeatherBox->setChecked(getValue("advanced/forceGoldfeather").toBool());
 	this->mdiCheckBox->setChecked(getValue("advanced/mdi").toBool());
@@ -27,6 +27,8 @@ public slots:
 	void on_enableOpenCSGBox_toggled(bool);
 	void on_cgalCacheSizeEdit_textChanged(const QString &);
 	void on_polysetCacheSizeEdit_textChanged(const QString &);
+	void on_importCacheSizeEdit_textChanged(const QString &);
+	void on_fontCacheSizeEdit_textChanged(const QString &);
 	void on_opencsgLimitEdit_textChanged(const QString &);
 	void on_forceGoldfeatherBox_toggled(bool);
 	void on_mouseWheelZoomBox_toggled(bool);
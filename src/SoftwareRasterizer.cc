@@ -0,0 +1,478 @@
+#include "SoftwareRasterizer.h"
+#include "polyset.h"
+#include "Polygon2d.h"
+#include "rendersettings.h"
+#include "imageutils.h"
+#include "printutils.h"
+#ifdef ENABLE_CGAL
+#include "CGAL_Nef_polyhedron.h"
+#endif
+
+#include <algorithm>
+#include <limits>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+// Tile edge length in pixels
+static const int TILE_SIZE = 32;
+// Below this many triangles, vertex setup is not worth extra threads
+static const size_t PARALLEL_SETUP_THRESHOLD = 65536;
+
+namespace {
+	// A triangle after projection and clipping, in window coordinates
+	struct ScreenTriangle {
+		double x[3], y[3], z[3];
+		unsigned char rgba[4];
+	};
+
+	unsigned char toByte(float c)
+	{
+		if (c <= 0.0f) return 0;
+		if (c >= 1.0f) return 255;
+		return (unsigned char)(c * 255.0f + 0.5f);
+	}
+
+	Eigen::Matrix4d perspective(double fovy, double aspect, double znear, double zfar)
+	{
+		double f = 1.0 / tan(fovy * M_PI / 360.0);
+		Eigen::Matrix4d m = Eigen::Matrix4d::Zero();
+		m(0,0) = f / aspect;
+		m(1,1) = f;
+		m(2,2) = (zfar + znear) / (znear - zfar);
+		m(2,3) = 2 * zfar * znear / (znear - zfar);
+		m(3,2) = -1;
+		return m;
+	}
+
+	Eigen::Matrix4d ortho(double l, double r, double b, double t, double n, double f)
+	{
+		Eigen::Matrix4d m = Eigen::Matrix4d::Identity();
+		m(0,0) = 2 / (r - l);
+		m(1,1) = 2 / (t - b);
+		m(2,2) = -2 / (f - n);
+		m(0,3) = -(r + l) / (r - l);
+		m(1,3) = -(t + b) / (t - b);
+		m(2,3) = -(f + n) / (f - n);
+		return m;
+	}
+
+	Eigen::Matrix4d lookAt(const Vector3d &eye, const Vector3d &center, const Vector3d &up)
+	{
+		Vector3d f = (center - eye).normalized();
+		Vector3d s = f.cross(up).normalized();
+		Vector3d u = s.cross(f);
+		Eigen::Matrix4d m = Eigen::Matrix4d::Identity();
+		m.block<1,3>(0,0) = s.transpose();
+		m.block<1,3>(1,0) = u.transpose();
+		m.block<1,3>(2,0) = -f.transpose();
+		m(0,3) = -s.dot(eye);
+		m(1,3) = -u.dot(eye);
+		m(2,3) = f.dot(eye);
+		return m;
+	}
+
+	Eigen::Matrix4d rotation(double deg, const Vector3d &axis)
+	{
+		Eigen::Matrix4d m = Eigen::Matrix4d::Identity();
+		m.block<3,3>(0,0) = Eigen::AngleAxisd(deg * M_PI / 180, axis).toRotationMatrix();
+		return m;
+	}
+
+	/*
+		Builds the same projection and modelview matrices as GLView::setupCamera().
+		Note that the gimbal camera puts its lookAt into the projection matrix,
+		which matters for lighting.
+	*/
+	void setupMatrices(const Camera &cam, double aspect, Eigen::Matrix4d &proj, Eigen::Matrix4d &modelview)
+	{
+		double far_far_away = RenderSettings::inst()->far_gl_clip_limit;
+		proj = Eigen::Matrix4d::Identity();
+		modelview = Eigen::Matrix4d::Identity();
+
+		double dist = cam.type == Camera::VECTOR ? (cam.center - cam.eye).norm() : cam.viewer_distance;
+		if (cam.projection == Camera::PERSPECTIVE) {
+			proj = perspective(cam.fov, aspect, 0.1*dist, 100*dist);
+		}
+		else {
+			proj = ortho(-cam.height/2*aspect, cam.height*aspect/2,
+									 -cam.height/2, cam.height/2,
+									 -far_far_away, +far_far_away);
+		}
+
+		switch (cam.type) {
+		case Camera::GIMBAL: {
+			proj = proj * lookAt(Vector3d(0.0, -cam.viewer_distance, 0.0), Vector3d::Zero(), Vector3d(0.0, 0.0, 1.0));
+			Eigen::Matrix4d trans = Eigen::Matrix4d::Identity();
+			trans.block<3,1>(0,3) = cam.object_trans;
+			modelview = rotation(cam.object_rot.x(), Vector3d::UnitX()) *
+				rotation(cam.object_rot.y(), Vector3d::UnitY()) *
+				rotation(cam.object_rot.z(), Vector3d::UnitZ()) * trans;
+			break;
+		}
+		case Camera::VECTOR: {
+			Vector3d dir(cam.eye - cam.center);
+			Vector3d up(0.0, 0.0, 1.0);
+			if (dir.cross(up).norm() < 0.001) { // View direction is ~parallel with up vector
+				up << 0.0, 1.0, 0.0;
+			}
+			modelview = lookAt(cam.eye, cam.center, up);
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	// Clips a polygon in clip coordinates against one plane (keeps dot(plane, v) >= 0)
+	void clipPlane(std::vector<Eigen::Vector4d> &poly, const Eigen::Vector4d &plane)
+	{
+		std::vector<Eigen::Vector4d> out;
+		for (size_t i = 0; i < poly.size(); i++) {
+			const Eigen::Vector4d &a = poly[i];
+			const Eigen::Vector4d &b = poly[(i+1) % poly.size()];
+			double da = plane.dot(a), db = plane.dot(b);
+			if (da >= 0) out.push_back(a);
+			if ((da >= 0) != (db >= 0)) out.push_back(a + (b - a) * (da / (da - db)));
+		}
+		poly.swap(out);
+	}
+
+	struct SetupParams {
+		Eigen::Matrix4d mvp;
+		Eigen::Matrix3d normalmatrix;
+		int width, height;
+	};
+
+	/*
+		Projects, lights and clips triangles [begin, end). Lighting follows the
+		fixed-function setup of GLView::initializeGL(): two white directional
+		lights in eye space, the default global ambient of 0.2 and no specular
+		term, with the face normal (one-sided, so back faces use the front normal).
+	*/
+	void setupTriangles(const std::vector<SoftwareRasterizer::Triangle> &triangles, size_t begin, size_t end,
+											const SetupParams &params, std::vector<ScreenTriangle> &result)
+	{
+		const Vector3d light0 = Vector3d(-1.0, -1.0, +1.0).normalized();
+		const Vector3d light1 = Vector3d(+1.0, +1.0, -1.0).normalized();
+		std::vector<Eigen::Vector4d> poly;
+		result.reserve(end - begin);
+
+		for (size_t i = begin; i < end; i++) {
+			const SoftwareRasterizer::Triangle &t = triangles[i];
+			Eigen::Vector3f color = t.color;
+			if (t.lit) {
+				Vector3d n = params.normalmatrix * (t.p[1] - t.p[0]).cross(t.p[2] - t.p[0]);
+				if (n.squaredNorm() == 0) continue;
+				n.normalize();
+				float intensity = 0.2f + std::max(0.0, n.dot(light0)) + std::max(0.0, n.dot(light1));
+				color *= intensity;
+			}
+
+			poly.clear();
+			for (int j = 0; j < 3; j++) {
+				poly.push_back(params.mvp * Eigen::Vector4d(t.p[j][0], t.p[j][1], t.p[j][2], 1.0));
+			}
+			clipPlane(poly, Eigen::Vector4d(0, 0, 1, 1)); // near
+			clipPlane(poly, Eigen::Vector4d(0, 0, -1, 1)); // far
+			if (poly.size() < 3) continue;
+
+			ScreenTriangle st;
+			for (int c = 0; c < 3; c++) st.rgba[c] = toByte(color[c]);
+			st.rgba[3] = 255;
+			double x[2], y[2], z[2];
+			for (size_t j = 0; j < poly.size(); j++) {
+				const Eigen::Vector4d &v = poly[j];
+				double sx = (v[0] / v[3] + 1) * 0.5 * params.width;
+				double sy = (v[1] / v[3] + 1) * 0.5 * params.height;
+				double sz = v[2] / v[3];
+				if (j >= 2) {
+					st.x[0] = x[0]; st.y[0] = y[0]; st.z[0] = z[0];
+					st.x[1] = x[1]; st.y[1] = y[1]; st.z[1] = z[1];
+					st.x[2] = sx; st.y[2] = sy; st.z[2] = sz;
+					result.push_back(st);
+				}
+				if (j == 0) { x[0] = sx; y[0] = sy; z[0] = sz; }
+				x[1] = sx; y[1] = sy; z[1] = sz;
+			}
+		}
+	}
+
+	struct RasterJobs {
+		const std::vector<ScreenTriangle> *triangles;
+		const std::vector<std::vector<size_t> > *bins;
+		int width, height, tiles_x;
+		unsigned char *color;
+		float *depth;
+
+		boost::mutex mutex;
+		size_t next;
+	};
+
+	void rasterizeTile(RasterJobs &jobs, size_t tile)
+	{
+		int x0 = (tile % jobs.tiles_x) * TILE_SIZE;
+		int y0 = (tile / jobs.tiles_x) * TILE_SIZE;
+		int x1 = std::min(x0 + TILE_SIZE, jobs.width);
+		int y1 = std::min(y0 + TILE_SIZE, jobs.height);
+
+		BOOST_FOREACH(size_t idx, (*jobs.bins)[tile]) {
+			const ScreenTriangle &t = (*jobs.triangles)[idx];
+			int a = 0, b = 1, c = 2;
+			double area = (t.x[b] - t.x[a]) * (t.y[c] - t.y[a]) - (t.y[b] - t.y[a]) * (t.x[c] - t.x[a]);
+			if (area == 0) continue;
+			if (area < 0) { std::swap(b, c); area = -area; }
+
+			int minx = std::max(x0, (int)floor(std::min(t.x[0], std::min(t.x[1], t.x[2]))));
+			int maxx = std::min(x1 - 1, (int)ceil(std::max(t.x[0], std::max(t.x[1], t.x[2]))));
+			int miny = std::max(y0, (int)floor(std::min(t.y[0], std::min(t.y[1], t.y[2]))));
+			int maxy = std::min(y1 - 1, (int)ceil(std::max(t.y[0], std::max(t.y[1], t.y[2]))));
+			if (minx > maxx || miny > maxy) continue;
+
+			// Edge functions e_i(x,y) = A_i*x + B_i*y + C_i, positive inside
+			const int v[3][2] = {{b, c}, {c, a}, {a, b}};
+			double A[3], B[3], C[3];
+			for (int i = 0; i < 3; i++) {
+				int p = v[i][0], q = v[i][1];
+				A[i] = t.y[p] - t.y[q];
+				B[i] = t.x[q] - t.x[p];
+				C[i] = t.x[p] * t.y[q] - t.x[q] * t.y[p];
+			}
+			double z[3] = {t.z[a] / area, t.z[b] / area, t.z[c] / area};
+
+			for (int py = miny; py <= maxy; py++) {
+				double cy = py + 0.5;
+				double cx = minx + 0.5;
+				double e[3];
+				for (int i = 0; i < 3; i++) e[i] = A[i] * cx + B[i] * cy + C[i];
+				for (int px = minx; px <= maxx; px++) {
+					if (e[0] >= 0 && e[1] >= 0 && e[2] >= 0) {
+						float depth = e[0] * z[0] + e[1] * z[1] + e[2] * z[2];
+						size_t offset = (size_t)py * jobs.width + px;
+						if (depth < jobs.depth[offset]) {
+							jobs.depth[offset] = depth;
+							std::copy(t.rgba, t.rgba + 4, jobs.color + 4 * offset);
+						}
+					}
+					for (int i = 0; i < 3; i++) e[i] += A[i];
+				}
+			}
+		}
+	}
+
+	void rasterWorker(RasterJobs &jobs)
+	{
+		while (true) {
+			size_t tile;
+			{
+				boost::mutex::scoped_lock lock(jobs.mutex);
+				if (jobs.next == jobs.bins->size()) return;
+				tile = jobs.next++;
+			}
+			rasterizeTile(jobs, tile);
+		}
+	}
+
+	// Draws a segment like a 2 pixel wide, aliased GL line without depth test
+	void drawSegment(unsigned char *color, int width, int height, const Eigen::Matrix4d &mvp,
+									 const SoftwareRasterizer::Segment &s)
+	{
+		double x[2], y[2];
+		for (int j = 0; j < 2; j++) {
+			Eigen::Vector4d v = mvp * Eigen::Vector4d(s.p[j][0], s.p[j][1], s.p[j][2], 1.0);
+			if (v[3] <= 0) return;
+			x[j] = (v[0] / v[3] + 1) * 0.5 * width;
+			y[j] = (v[1] / v[3] + 1) * 0.5 * height;
+		}
+		unsigned char rgba[4] = {toByte(s.color[0]), toByte(s.color[1]), toByte(s.color[2]), 255};
+		double dx = x[1] - x[0], dy = y[1] - y[0];
+		bool xmajor = fabs(dx) >= fabs(dy);
+		int steps = (int)ceil(std::max(fabs(dx), fabs(dy)));
+		for (int i = 0; i <= steps; i++) {
+			double f = steps ? double(i) / steps : 0;
+			double px = x[0] + f * dx, py = y[0] + f * dy;
+			for (int w = 0; w < 2; w++) {
+				int ix = xmajor ? (int)floor(px) : (int)floor(px - 0.5) + w;
+				int iy = xmajor ? (int)floor(py - 0.5) + w : (int)floor(py);
+				if (ix < 0 || iy < 0 || ix >= width || iy >= height) continue;
+				std::copy(rgba, rgba + 4, color + 4 * ((size_t)iy * width + ix));
+			}
+		}
+	}
+}
+
+SoftwareRasterizer::SoftwareRasterizer(shared_ptr<const Geometry> geom, const ColorScheme &cs)
+{
+	this->background = ColorMap::getColor(cs, BACKGROUND_COLOR).head<3>();
+	this->bbox.setEmpty();
+
+	// The colors below are the ones CGALRenderer uses for the same geometry types
+	if (shared_ptr<const PolySet> ps = dynamic_pointer_cast<const PolySet>(geom)) {
+		if (ps->getDimension() == 2) {
+			addPolySet(*ps, Eigen::Vector3f(0.0f, 0.75f, 0.60f), false, -0.1);
+		}
+		else {
+			addPolySet(*ps, ColorMap::getColor(cs, OPENCSG_FACE_FRONT_COLOR).head<3>(), true, 0);
+		}
+	}
+	else if (shared_ptr<const Polygon2d> poly = dynamic_pointer_cast<const Polygon2d>(geom)) {
+		shared_ptr<PolySet> ps(poly->tessellate());
+		addPolySet(*ps, Eigen::Vector3f(0.0f, 0.75f, 0.60f), false, -0.1);
+		BOOST_FOREACH(const Outline2d &o, poly->outlines()) {
+			for (size_t i = 0; i < o.vertices.size(); i++) {
+				const Vector2d &a = o.vertices[i];
+				const Vector2d &b = o.vertices[(i+1) % o.vertices.size()];
+				Segment s;
+				s.p[0] = Vector3d(a[0], a[1], -0.1);
+				s.p[1] = Vector3d(b[0], b[1], -0.1);
+				s.color = Eigen::Vector3f(1.0f, 0.0f, 0.0f);
+				this->segments.push_back(s);
+			}
+		}
+	}
+#ifdef ENABLE_CGAL
+	else if (shared_ptr<const CGAL_Nef_polyhedron> N = dynamic_pointer_cast<const CGAL_Nef_polyhedron>(geom)) {
+		shared_ptr<const PolySet> ps = N->getMesh();
+		if (ps) addPolySet(*ps, ColorMap::getColor(cs, CGAL_FACE_FRONT_COLOR).head<3>(), true, 0);
+	}
+#endif
+}
+
+/*!
+	Splits the polygons the same way PolySet::render_surface() does: quads
+	into two triangles and larger polygons into a fan around their center.
+*/
+void SoftwareRasterizer::addPolySet(const PolySet &ps, const Eigen::Vector3f &color, bool lit, double z)
+{
+	if (ps.isEmpty()) return;
+	this->bbox.extend(ps.getBoundingBox());
+
+	Triangle t;
+	t.color = color;
+	t.lit = lit;
+	const Vector3d offset(0, 0, z);
+	BOOST_FOREACH(const PolySet::Polygon &poly, ps.polygons) {
+		if (poly.size() < 3) continue;
+		if (poly.size() == 3) {
+			t.p[0] = poly[0] + offset; t.p[1] = poly[1] + offset; t.p[2] = poly[2] + offset;
+			this->triangles.push_back(t);
+		}
+		else if (poly.size() == 4) {
+			t.p[0] = poly[0] + offset; t.p[1] = poly[1] + offset; t.p[2] = poly[3] + offset;
+			this->triangles.push_back(t);
+			t.p[0] = poly[2] + offset; t.p[1] = poly[3] + offset; t.p[2] = poly[1] + offset;
+			this->triangles.push_back(t);
+		}
+		else {
+			Vector3d center = Vector3d::Zero();
+			BOOST_FOREACH(const Vector3d &p, poly) center += p;
+			center /= poly.size();
+			for (size_t j = 1; j <= poly.size(); j++) {
+				t.p[0] = center + offset;
+				t.p[1] = poly[j - 1] + offset;
+				t.p[2] = poly[j % poly.size()] + offset;
+				this->triangles.push_back(t);
+			}
+		}
+	}
+}
+
+void SoftwareRasterizer::render(const Camera &cam, std::vector<unsigned char> &pixels, unsigned int nthreads) const
+{
+	int width = cam.pixel_width, height = cam.pixel_height;
+	size_t npixels = (size_t)width * height;
+
+	SetupParams params;
+	Eigen::Matrix4d proj, modelview;
+	setupMatrices(cam, double(width) / height, proj, modelview);
+	params.mvp = proj * modelview;
+	params.normalmatrix = modelview.block<3,3>(0,0).inverse().transpose();
+	params.width = width;
+	params.height = height;
+
+	if (nthreads == 0) nthreads = std::max(1u, boost::thread::hardware_concurrency());
+
+	// Vertex setup, split into contiguous ranges to keep the drawing order
+	std::vector<ScreenTriangle> screen;
+	if (nthreads > 1 && this->triangles.size() >= PARALLEL_SETUP_THRESHOLD) {
+		std::vector<std::vector<ScreenTriangle> > parts(nthreads);
+		size_t chunk = (this->triangles.size() + nthreads - 1) / nthreads;
+		boost::thread_group threads;
+		for (unsigned int i = 0; i < nthreads; i++) {
+			size_t begin = std::min(i * chunk, this->triangles.size());
+			size_t end = std::min(begin + chunk, this->triangles.size());
+			threads.create_thread(boost::bind(&setupTriangles, boost::cref(this->triangles), begin, end,
+																				boost::cref(params), boost::ref(parts[i])));
+		}
+		threads.join_all();
+		BOOST_FOREACH(const std::vector<ScreenTriangle> &part, parts) {
+			screen.insert(screen.end(), part.begin(), part.end());
+		}
+	}
+	else {
+		setupTriangles(this->triangles, 0, this->triangles.size(), params, screen);
+	}
+
+	// Bin triangles into the tiles their screen bounding box overlaps
+	int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+	int tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+	std::vector<std::vector<size_t> > bins(tiles_x * tiles_y);
+	for (size_t i = 0; i < screen.size(); i++) {
+		const ScreenTriangle &t = screen[i];
+		double minx = std::min(t.x[0], std::min(t.x[1], t.x[2]));
+		double maxx = std::max(t.x[0], std::max(t.x[1], t.x[2]));
+		double miny = std::min(t.y[0], std::min(t.y[1], t.y[2]));
+		double maxy = std::max(t.y[0], std::max(t.y[1], t.y[2]));
+		if (maxx < 0 || maxy < 0 || minx >= width || miny >= height) continue;
+		int tx0 = std::max(0, (int)minx / TILE_SIZE), tx1 = std::min(tiles_x - 1, (int)maxx / TILE_SIZE);
+		int ty0 = std::max(0, (int)miny / TILE_SIZE), ty1 = std::min(tiles_y - 1, (int)maxy / TILE_SIZE);
+		for (int ty = ty0; ty <= ty1; ty++) {
+			for (int tx = tx0; tx <= tx1; tx++) bins[ty * tiles_x + tx].push_back(i);
+		}
+	}
+
+	// Window coordinates have y pointing up, like the GL framebuffer
+	std::vector<unsigned char> color(4 * npixels);
+	for (size_t i = 0; i < npixels; i++) {
+		for (int c = 0; c < 3; c++) color[4*i + c] = toByte(this->background[c]);
+		color[4*i + 3] = 255;
+	}
+	std::vector<float> depth(npixels, std::numeric_limits<float>::max());
+
+	RasterJobs jobs;
+	jobs.triangles = &screen;
+	jobs.bins = &bins;
+	jobs.width = width;
+	jobs.height = height;
+	jobs.tiles_x = tiles_x;
+	jobs.color = npixels ? &color[0] : NULL;
+	jobs.depth = npixels ? &depth[0] : NULL;
+	jobs.next = 0;
+
+	nthreads = std::min<size_t>(nthreads, bins.size());
+	if (nthreads > 1) {
+		boost::thread_group threads;
+		for (unsigned int i = 0; i < nthreads; i++) {
+			threads.create_thread(boost::bind(&rasterWorker, boost::ref(jobs)));
+		}
+		threads.join_all();
+	}
+	else {
+		rasterWorker(jobs);
+	}
+
+	BOOST_FOREACH(const Segment &s, this->segments) {
+		drawSegment(jobs.color, width, height, params.mvp, s);
+	}
+
+	pixels.resize(4 * npixels);
+	if (npixels) flip_image(&color[0], &pixels[0], 4, width, height);
+}
+
+bool SoftwareRasterizer::save(const Camera &cam, std::ostream &output, unsigned int nthreads) const
+{
+	std::vector<unsigned char> pixels;
+	render(cam, pixels, nthreads);
+	if (pixels.empty()) return false;
+	return write_png(output, &pixels[0], cam.pixel_width, cam.pixel_height);
+}
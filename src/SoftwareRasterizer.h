@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Geometry.h"
+#include "Camera.h"
+#include "colormap.h"
+#include "memory.h"
+#include <vector>
+#include <iostream>
+
+/*!
+	Renders a Geometry into an RGB image without an OpenGL context.
+
+	The geometry is tessellated once into world-space triangles (and, for
+	2D objects, outline segments). render() then mimics what GLView and
+	CGALRenderer produce for the same camera: the same projection and
+	modelview matrices, the two fixed-function lights and the colors of the
+	given ColorScheme. Triangles are binned into screen tiles which are
+	rasterized in parallel against a depth buffer.
+
+	render() is const and keeps all of its state on the stack, so one
+	rasterizer may render several cameras concurrently.
+*/
+class SoftwareRasterizer
+{
+public:
+	SoftwareRasterizer(shared_ptr<const Geometry> geom, const ColorScheme &cs);
+
+	BoundingBox getBoundingBox() const { return this->bbox; }
+	// Renders to tightly packed RGBA rows, top row first. nthreads == 0
+	// uses all hardware threads.
+	void render(const Camera &cam, std::vector<unsigned char> &pixels, unsigned int nthreads = 0) const;
+	bool save(const Camera &cam, std::ostream &output, unsigned int nthreads = 0) const;
+
+	// Colors are kept as Vector3f to stay clear of Eigen's alignment rules
+	struct Triangle {
+		Vector3d p[3];
+		Eigen::Vector3f color;
+		bool lit;
+	};
+	struct Segment {
+		Vector3d p[2];
+		Eigen::Vector3f color;
+	};
+
+private:
+	void addPolySet(const class PolySet &ps, const Eigen::Vector3f &color, bool lit, double z);
+
+	std::vector<Triangle> triangles;
+	std::vector<Segment> segments;
+	BoundingBox bbox;
+	Eigen::Vector3f background;
+};
@@ -15,11 +15,15 @@
 #include <CGAL/Handle_hash_function.h>
 #include "svg.h"
 #include "Reindexer.h"
+#include "CGALCache.h"
 
 #include <map>
 #include <queue>
+#include <algorithm>
 #include <boost/foreach.hpp>
 #include <boost/unordered_set.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 
 namespace /* anonymous */ {
 	template<typename Result, typename V>
@@ -355,33 +359,105 @@ namespace CGALUtils {
 		return err;
 	}
 
+	typedef CGAL::Exact_predicates_inexact_constructions_kernel K;
+
+	// Below this number of points, the hull is computed in one pass
+	static const size_t PARALLEL_HULL_THRESHOLD = 20000;
+
+	/*!
+		Computes the convex hull of points and appends its vertices to result.
+		If the hull is degenerate (e.g. coplanar points), all points are kept.
+	*/
+	static void reduceToHullVertices(const std::vector<K::Point_3> &points, std::vector<K::Point_3> &result)
+	{
+		if (points.size() < 4) {
+			result = points;
+			return;
+		}
+		CGAL::Object hull;
+		CGAL::convex_hull_3(points.begin(), points.end(), hull);
+		CGAL::Polyhedron_3<K> poly;
+		if (CGAL::assign(poly, hull)) {
+			result.reserve(poly.size_of_vertices());
+			for (CGAL::Polyhedron_3<K>::Vertex_const_iterator i = poly.vertices_begin(); i != poly.vertices_end(); ++i) {
+				result.push_back(i->point());
+			}
+		}
+		else {
+			result = points;
+		}
+	}
+
+	/*!
+		Removes points which cannot be vertices of the convex hull. The points are
+		split into interleaved subsets whose hulls are computed in parallel;
+		the hull of all points is the hull of the union of the subset hull
+		vertices, and points interior to any subset hull are dropped.
+	*/
+	static void reduceHullPoints(std::vector<K::Point_3> &points)
+	{
+		unsigned int nthreads = std::max(1u, boost::thread::hardware_concurrency());
+		if (points.size() < PARALLEL_HULL_THRESHOLD || nthreads == 1) return;
+
+		std::vector<std::vector<K::Point_3> > subsets(nthreads), reduced(nthreads);
+		for (unsigned int t = 0; t < nthreads; t++) subsets[t].reserve(points.size() / nthreads + 1);
+		for (size_t i = 0; i < points.size(); i++) subsets[i % nthreads].push_back(points[i]);
+
+		boost::thread_group threads;
+		for (unsigned int t = 0; t < nthreads; t++) {
+			threads.create_thread(boost::bind(reduceToHullVertices, boost::cref(subsets[t]), boost::ref(reduced[t])));
+		}
+		threads.join_all();
+
+		points.clear();
+		BOOST_FOREACH(const std::vector<K::Point_3> &r, reduced) {
+			points.insert(points.end(), r.begin(), r.end());
+		}
+	}
+
 	bool applyHull(const Geometry::ChildList &children, PolySet &result)
 	{
-		typedef CGAL::Exact_predicates_inexact_constructions_kernel K;
-		// Collect point cloud
-		std::set<K::Point_3> points;
+		// Collect point cloud. PolySets repeat each vertex for every polygon
+		// using it, so duplicates are removed after collecting.
+		size_t numpoints = 0;
+		BOOST_FOREACH(const Geometry::ChildItem &item, children) {
+			const shared_ptr<const Geometry> &chgeom = item.second;
+			if (const CGAL_Nef_polyhedron *N = dynamic_cast<const CGAL_Nef_polyhedron *>(chgeom.get())) {
+				if (N->p3) numpoints += N->p3->number_of_vertices();
+			}
+			else if (const PolySet *ps = dynamic_cast<const PolySet *>(chgeom.get())) {
+				BOOST_FOREACH(const PolySet::Polygon &p, ps->polygons) numpoints += p.size();
+			}
+		}
 
+		std::vector<K::Point_3> points;
+		points.reserve(numpoints);
 		BOOST_FOREACH(const Geometry::ChildItem &item, children) {
 			const shared_ptr<const Geometry> &chgeom = item.second;
 			const CGAL_Nef_polyhedron *N = dynamic_cast<const CGAL_Nef_polyhedron *>(chgeom.get());
 			if (N) {
+				if (!N->p3) continue;
 				for (CGAL_Nef_polyhedron3::Vertex_const_iterator i = N->p3->vertices_begin(); i != N->p3->vertices_end(); ++i) {
-					points.insert(K::Point_3(to_double(i->point()[0]),to_double(i->point()[1]),to_double(i->point()[2])));
+					points.push_back(K::Point_3(to_double(i->point()[0]),to_double(i->point()[1]),to_double(i->point()[2])));
 				}
 			} else {
 				const PolySet *ps = dynamic_cast<const PolySet *>(chgeom.get());
 				if (ps) {
 					BOOST_FOREACH(const PolySet::Polygon &p, ps->polygons) {
 						BOOST_FOREACH(const Vector3d &v, p) {
-							points.insert(K::Point_3(v[0], v[1], v[2]));
+							points.push_back(K::Point_3(v[0], v[1], v[2]));
 						}
 					}
 				}
 			}
 		}
+		std::sort(points.begin(), points.end());
+		points.erase(std::unique(points.begin(), points.end()), points.end());
 
 		if (points.size() <= 3) return false;
 
+		reduceHullPoints(points);
+
 		// Apply hull
 		if (points.size() >= 4) {
 			CGAL::Polyhedron_3<K> r;
@@ -430,161 +506,225 @@ namespace CGALUtils {
 		return visited.size() == p.size_of_facets();
 	}
 
-	Geometry const * applyMinkowski(const Geometry::ChildList &children)
+	/*!
+		Splits a minkowski() operand into convex parts, given as the vertices of
+		each part. Throws if the operand cannot be handled, in which case the
+		caller falls back to Nef minkowski.
+	*/
+	static void decomposeMinkowskiOperand(const Geometry *operand, int i, CGALCache::ConvexParts &parts)
 	{
-		CGAL::Timer t,t_tot;
-		assert(children.size() >= 2);
-		Geometry::ChildList::const_iterator it = children.begin();
-		t_tot.start();
-		Geometry const* operands[2] = {it->second.get(), NULL};
-		try {
-			while (++it != children.end()) {
-				operands[1] = it->second.get();
+		std::list<CGAL_Polyhedron> P;
+		CGAL_Polyhedron poly;
 
-				typedef CGAL::Exact_predicates_inexact_constructions_kernel Hull_kernel;
+		const PolySet * ps = dynamic_cast<const PolySet *>(operand);
 
-				std::list<CGAL_Polyhedron> P[2];
-				std::list<CGAL::Polyhedron_3<Hull_kernel> > result_parts;
+		const CGAL_Nef_polyhedron * nef = dynamic_cast<const CGAL_Nef_polyhedron *>(operand);
 
-				for (int i = 0; i < 2; i++) {
-					CGAL_Polyhedron poly;
-
-					const PolySet * ps = dynamic_cast<const PolySet *>(operands[i]);
-
-					const CGAL_Nef_polyhedron * nef = dynamic_cast<const CGAL_Nef_polyhedron *>(operands[i]);
-
-					if (ps) CGALUtils::createPolyhedronFromPolySet(*ps, poly);
-					else if (nef && nef->p3->is_simple()) nefworkaround::convert_to_Polyhedron<CGAL_Kernel3>(*nef->p3, poly);
-					else throw 0;
-
-					if ((ps && ps->is_convex()) ||
-							(!ps && is_weakly_convex(poly))) {
-						PRINTDB("Minkowski: child %d is convex and %s",i % (ps?"PolySet":"Nef") );
-						P[i].push_back(poly);
-					} else {
-						CGAL_Nef_polyhedron3 decomposed_nef;
-
-						if (ps) {
-							PRINTDB("Minkowski: child %d is nonconvex PolySet, transforming to Nef and decomposing...", i);
-							CGAL_Nef_polyhedron *p = createNefPolyhedronFromGeometry(*ps);
-							decomposed_nef = *p->p3;
-							delete p;
-						} else {
-							PRINTDB("Minkowski: child %d is nonconvex Nef, decomposing...",i);
-							decomposed_nef = *nef->p3;
-						}
+		if (ps) CGALUtils::createPolyhedronFromPolySet(*ps, poly);
+		else if (nef && nef->p3->is_simple()) nefworkaround::convert_to_Polyhedron<CGAL_Kernel3>(*nef->p3, poly);
+		else throw 0;
 
-						CGAL::convex_decomposition_3(decomposed_nef);
+		if ((ps && ps->is_convex()) ||
+				(!ps && is_weakly_convex(poly))) {
+			PRINTDB("Minkowski: child %d is convex and %s",i % (ps?"PolySet":"Nef") );
+			P.push_back(poly);
+		} else {
+			CGAL_Nef_polyhedron3 decomposed_nef;
 
-						// the first volume is the outer volume, which ignored in the decomposition
-						CGAL_Nef_polyhedron3::Volume_const_iterator ci = ++decomposed_nef.volumes_begin();
-						for( ; ci != decomposed_nef.volumes_end(); ++ci) {
-							if(ci->mark()) {
-								CGAL_Polyhedron poly;
-								decomposed_nef.convert_inner_shell_to_polyhedron(ci->shells_begin(), poly);
-								P[i].push_back(poly);
-							}
-						}
+			if (ps) {
+				PRINTDB("Minkowski: child %d is nonconvex PolySet, transforming to Nef and decomposing...", i);
+				CGAL_Nef_polyhedron *p = createNefPolyhedronFromGeometry(*ps);
+				decomposed_nef = *p->p3;
+				delete p;
+			} else {
+				PRINTDB("Minkowski: child %d is nonconvex Nef, decomposing...",i);
+				decomposed_nef = *nef->p3;
+			}
 
+			CGAL::convex_decomposition_3(decomposed_nef);
 
-						PRINTDB("Minkowski: decomposed into %d convex parts", P[i].size());
-					}
+			// the first volume is the outer volume, which ignored in the decomposition
+			CGAL_Nef_polyhedron3::Volume_const_iterator ci = ++decomposed_nef.volumes_begin();
+			for( ; ci != decomposed_nef.volumes_end(); ++ci) {
+				if(ci->mark()) {
+					CGAL_Polyhedron poly;
+					decomposed_nef.convert_inner_shell_to_polyhedron(ci->shells_begin(), poly);
+					P.push_back(poly);
 				}
+			}
 
-				std::vector<Hull_kernel::Point_3> points[2];
-				std::vector<Hull_kernel::Point_3> minkowski_points;
-
-				for (int i = 0; i < P[0].size(); i++) {
-					for (int j = 0; j < P[1].size(); j++) {
-						t.start();
-						points[0].clear();
-						points[1].clear();
-
-						for (int k = 0; k < 2; k++) {
-							std::list<CGAL_Polyhedron>::iterator it = P[k].begin();
-							std::advance(it, k==0?i:j);
-
-							CGAL_Polyhedron const& poly = *it;
-							points[k].reserve(poly.size_of_vertices());
-
-							for (CGAL_Polyhedron::Vertex_const_iterator pi = poly.vertices_begin(); pi != poly.vertices_end(); ++pi) {
-								CGAL_Polyhedron::Point_3 const& p = pi->point();
-								points[k].push_back(Hull_kernel::Point_3(to_double(p[0]),to_double(p[1]),to_double(p[2])));
-							}
-						}
+			PRINTDB("Minkowski: decomposed into %d convex parts", P.size());
+		}
 
-						minkowski_points.clear();
-						minkowski_points.reserve(points[0].size() * points[1].size());
-						for (int i = 0; i < points[0].size(); i++) {
-							for (int j = 0; j < points[1].size(); j++) {
-								minkowski_points.push_back(points[0][i]+(points[1][j]-CGAL::ORIGIN));
-							}
-						}
+		parts.resize(P.size());
+		size_t k = 0;
+		BOOST_FOREACH(const CGAL_Polyhedron &poly, P) {
+			std::vector<Vector3d> &points = parts[k++];
+			points.reserve(poly.size_of_vertices());
+			for (CGAL_Polyhedron::Vertex_const_iterator pi = poly.vertices_begin(); pi != poly.vertices_end(); ++pi) {
+				CGAL_Polyhedron::Point_3 const& p = pi->point();
+				points.push_back(Vector3d(to_double(p[0]),to_double(p[1]),to_double(p[2])));
+			}
+		}
+	}
 
-						if (minkowski_points.size() <= 3) {
-							t.stop();
-							continue;
-						}
+	/*!
+		Computes the minkowski sum of two convex parts as the convex hull of
+		all pairwise vertex sums. result is left empty if the sum is degenerate.
+	*/
+	static void minkowskiConvexParts(const std::vector<Vector3d> &part0, const std::vector<Vector3d> &part1,
+																	 CGAL::Polyhedron_3<K> &result)
+	{
+		std::vector<K::Point_3> minkowski_points;
+		minkowski_points.reserve(part0.size() * part1.size());
+		for (size_t i = 0; i < part0.size(); i++) {
+			for (size_t j = 0; j < part1.size(); j++) {
+				Vector3d v = part0[i] + part1[j];
+				minkowski_points.push_back(K::Point_3(v[0], v[1], v[2]));
+			}
+		}
 
+		if (minkowski_points.size() <= 3) return;
 
-						CGAL::Polyhedron_3<Hull_kernel> result;
-						t.stop();
-						PRINTDB("Minkowski: Point cloud creation (%d ⨉ %d -> %d) took %f ms", points[0].size() % points[1].size() % minkowski_points.size() % (t.time()*1000));
-						t.reset();
+		CGAL::convex_hull_3(minkowski_points.begin(), minkowski_points.end(), result);
 
-						t.start();
+		std::vector<K::Point_3> strict_points;
+		strict_points.reserve(minkowski_points.size());
 
-						CGAL::convex_hull_3(minkowski_points.begin(), minkowski_points.end(), result);
+		for (CGAL::Polyhedron_3<K>::Vertex_iterator i = result.vertices_begin(); i != result.vertices_end(); ++i) {
+			K::Point_3 const& p = i->point();
 
-						std::vector<Hull_kernel::Point_3> strict_points;
-						strict_points.reserve(minkowski_points.size());
+			CGAL::Polyhedron_3<K>::Vertex::Halfedge_handle h,e;
+			h = i->halfedge();
+			e = h;
+			bool collinear = false;
+			bool coplanar = true;
 
-						for (CGAL::Polyhedron_3<Hull_kernel>::Vertex_iterator i = result.vertices_begin(); i != result.vertices_end(); ++i) {
-							Hull_kernel::Point_3 const& p = i->point();
+			do {
+				K::Point_3 const& q = h->opposite()->vertex()->point();
+				if (coplanar && !CGAL::coplanar(p,q,
+																				h->next_on_vertex()->opposite()->vertex()->point(),
+																				h->next_on_vertex()->next_on_vertex()->opposite()->vertex()->point())) {
+					coplanar = false;
+				}
 
-							CGAL::Polyhedron_3<Hull_kernel>::Vertex::Halfedge_handle h,e;
-							h = i->halfedge();
-							e = h;
-							bool collinear = false;
-							bool coplanar = true;
 
-							do {
-								Hull_kernel::Point_3 const& q = h->opposite()->vertex()->point();
-								if (coplanar && !CGAL::coplanar(p,q,
-																h->next_on_vertex()->opposite()->vertex()->point(),
-																h->next_on_vertex()->next_on_vertex()->opposite()->vertex()->point())) {
-									coplanar = false;
-								}
+				for (CGAL::Polyhedron_3<K>::Vertex::Halfedge_handle j = h->next_on_vertex();
+						 j != h && !collinear && ! coplanar;
+						 j = j->next_on_vertex()) {
 
+					K::Point_3 const& r = j->opposite()->vertex()->point();
+					if (CGAL::collinear(p,q,r)) {
+						collinear = true;
+					}
+				}
 
-								for (CGAL::Polyhedron_3<Hull_kernel>::Vertex::Halfedge_handle j = h->next_on_vertex();
-									 j != h && !collinear && ! coplanar;
-									 j = j->next_on_vertex()) {
+				h = h->next_on_vertex();
+			} while (h != e && !collinear);
 
-									Hull_kernel::Point_3 const& r = j->opposite()->vertex()->point();
-									if (CGAL::collinear(p,q,r)) {
-										collinear = true;
-									}
-								}
+			if (!collinear && !coplanar)
+				strict_points.push_back(p);
+		}
 
-								h = h->next_on_vertex();
-							} while (h != e && !collinear);
+		result.clear();
+		CGAL::convex_hull_3(strict_points.begin(), strict_points.end(), result);
+	}
 
-							if (!collinear && !coplanar)
-								strict_points.push_back(p);
-						}
+	/*!
+		Pairs of convex parts still to be summed. Worker threads pick the next
+		pair under the mutex and store the hull in the slot for that pair, so
+		the results come out in the same order as a serial run.
+	*/
+	struct MinkowskiJobs {
+		const CGALCache::ConvexParts *parts[2];
+		std::vector<CGAL::Polyhedron_3<K> > results;
+		size_t next;
+		bool failed;
+		boost::mutex mutex;
+	};
 
-						result.clear();
-						CGAL::convex_hull_3(strict_points.begin(), strict_points.end(), result);
+	static void minkowskiWorker(MinkowskiJobs &jobs)
+	{
+		size_t n1 = jobs.parts[1]->size();
+		while (true) {
+			size_t idx;
+			{
+				boost::mutex::scoped_lock lock(jobs.mutex);
+				if (jobs.failed) break;
+				idx = jobs.next++;
+			}
+			if (idx >= jobs.results.size()) break;
+			try {
+				minkowskiConvexParts((*jobs.parts[0])[idx / n1], (*jobs.parts[1])[idx % n1], jobs.results[idx]);
+			}
+			catch (...) {
+				// Reported to applyMinkowski(), which falls back to Nef minkowski
+				boost::mutex::scoped_lock lock(jobs.mutex);
+				jobs.failed = true;
+			}
+		}
+	}
 
+	Geometry const * applyMinkowski(const Geometry::ChildList &children)
+	{
+		CGAL::Timer t,t_tot;
+		assert(children.size() >= 2);
+		Geometry::ChildList::const_iterator it = children.begin();
+		t_tot.start();
+		Geometry const* operands[2] = {it->second.get(), NULL};
+		try {
+			while (++it != children.end()) {
+				operands[1] = it->second.get();
 
-						t.stop();
-						PRINTDB("Minkowski: Computing convex hull took %f s", t.time());
-						t.reset();
+				// Children may be decomposed already by an earlier minkowski();
+				// intermediate results are decomposed every time.
+				shared_ptr<const CGALCache::ConvexParts> parts[2];
+				for (int i = 0; i < 2; i++) {
+					shared_ptr<const Geometry> child;
+					if (i == 1) child = it->second;
+					else if (it == boost::next(children.begin())) child = children.begin()->second;
+
+					if (child) parts[i] = CGALCache::instance()->getDecomposition(child);
+					if (!parts[i]) {
+						CGALCache::ConvexParts *decomposed = new CGALCache::ConvexParts;
+						parts[i].reset(decomposed);
+						decomposeMinkowskiOperand(operands[i], i, *decomposed);
+						if (child) CGALCache::instance()->insertDecomposition(child, parts[i]);
+					}
+					else {
+						PRINTDB("Minkowski: child %d decomposition found in cache (%d parts)", i % parts[i]->size());
+					}
+				}
 
-						result_parts.push_back(result);
+				t.start();
+				MinkowskiJobs jobs;
+				jobs.parts[0] = parts[0].get();
+				jobs.parts[1] = parts[1].get();
+				jobs.results.resize(parts[0]->size() * parts[1]->size());
+				jobs.next = 0;
+				jobs.failed = false;
+
+				unsigned int nthreads = std::max(1u, boost::thread::hardware_concurrency());
+				nthreads = std::min(nthreads, (unsigned int)jobs.results.size());
+				if (nthreads <= 1) {
+					minkowskiWorker(jobs);
+				}
+				else {
+					boost::thread_group threads;
+					for (unsigned int i = 0; i < nthreads; i++) {
+						threads.create_thread(boost::bind(minkowskiWorker, boost::ref(jobs)));
 					}
+					threads.join_all();
+				}
+				if (jobs.failed) throw 0;
+
+				std::list<CGAL::Polyhedron_3<K> > result_parts;
+				BOOST_FOREACH(const CGAL::Polyhedron_3<K> &result, jobs.results) {
+					if (result.size_of_vertices() > 0) result_parts.push_back(result);
 				}
+				t.stop();
+				PRINTDB("Minkowski: Computing %d convex hulls on %d threads took %f s", jobs.results.size() % nthreads % t.time());
+				t.reset();
 
 				if (it != boost::next(children.begin()))
 					delete operands[0];
@@ -597,12 +737,13 @@ namespace CGALUtils {
 					t.start();
 					PRINTDB("Minkowski: Computing union of %d parts",result_parts.size());
 					Geometry::ChildList fake_children;
-					for (std::list<CGAL::Polyhedron_3<Hull_kernel> >::iterator i = result_parts.begin(); i != result_parts.end(); ++i) {
+					for (std::list<CGAL::Polyhedron_3<K> >::iterator i = result_parts.begin(); i != result_parts.end(); ++i) {
 						PolySet ps(3,true);
 						createPolySetFromPolyhedron(*i, ps);
 						fake_children.push_back(std::make_pair((const AbstractNode*)NULL,
 															   shared_ptr<const Geometry>(createNefPolyhedronFromGeometry(ps))));
 					}
+					// Nef_nary_union_3 merges the parts pairwise as a balanced tree
 					CGAL_Nef_polyhedron *N = new CGAL_Nef_polyhedron;
 					CGALUtils::applyOperator(fake_children, *N, OPENSCAD_UNION);
 					t.stop();
@@ -1,5 +1,16 @@
 #include "clipper-utils.h"
 #include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <limits>
+#include <stdint.h>
+
+static bool compareFirst(const std::pair<uint64_t, const ClipperLib::Paths *> &a,
+												 const std::pair<uint64_t, const ClipperLib::Paths *> &b)
+{
+	return a.first < b.first;
+}
 
 namespace ClipperUtils {
 
@@ -16,6 +27,9 @@ namespace ClipperUtils {
 	}
 
 	ClipperLib::Paths fromPolygon2d(const Polygon2d &poly) {
+		// Polygons from a previous Clipper operation are reused without conversion
+		if (poly.clipperPaths()) return *poly.clipperPaths();
+
 		ClipperLib::Paths result;
 		BOOST_FOREACH(const Outline2d &outline, poly.outlines()) {
 			result.push_back(fromOutline2d(outline, poly.isSanitized() ? true : false));
@@ -38,36 +52,17 @@ namespace ClipperUtils {
  /*!
 	 We want to use a PolyTree to convert to Polygon2d, since only PolyTrees
 	 have an explicit notion of holes.
-	 We could use a Paths structure, but we'd have to check the orientation of each
-	 path before adding it to the Polygon2d.
+	 The resulting Polygon2d keeps the integer contours; the double precision
+	 outlines are cleaned and built on demand, see Polygon2d::materialize().
  */
 	Polygon2d *toPolygon2d(const ClipperLib::PolyTree &poly) {
-		const double CLEANING_DISTANCE = 0.001 * CLIPPER_SCALE;
-
-		Polygon2d *result = new Polygon2d;
+		ClipperLib::Paths *paths = new ClipperLib::Paths;
 		const ClipperLib::PolyNode *node = poly.GetFirst();
 		while (node) {
-			Outline2d outline;
-			// Apparently, when using offset(), clipper gets the hole status wrong
-			//outline.positive = !node->IsHole();
-			outline.positive = Orientation(node->Contour);
-
-			ClipperLib::Path cleaned_path;
-			ClipperLib::CleanPolygon(node->Contour, cleaned_path, CLEANING_DISTANCE);
-
-			// CleanPolygon can in some cases reduce the polygon down to no vertices
-			if (cleaned_path.size() >= 3)  {
-				BOOST_FOREACH(const ClipperLib::IntPoint &ip, cleaned_path) {
-					Vector2d v(1.0*ip.X/CLIPPER_SCALE, 1.0*ip.Y/CLIPPER_SCALE);
-					outline.vertices.push_back(v);
-				}
-				result->addOutline(outline);
-			}
-
+			paths->push_back(node->Contour);
 			node = node->GetNext();
 		}
-		result->setSanitized(true);
-		return result;
+		return new Polygon2d(shared_ptr<const ClipperLib::Paths>(paths));
 	}
 
 	ClipperLib::Paths process(const ClipperLib::Paths &polygons, 
@@ -81,11 +76,179 @@ namespace ClipperUtils {
 		return result;
 	}
 
+	// Below this number of operands, apply() runs a single Clipper pass
+	static const size_t REDUCTION_THRESHOLD = 16;
+	// Number of operands unioned in one Clipper pass at the leaves of the reduction
+	static const size_t UNION_LEAF_SIZE = 32;
+
+	static ClipperLib::IntRect getBoundingBox(const ClipperLib::Paths &paths)
+	{
+		ClipperLib::IntRect box;
+		box.left = box.top = std::numeric_limits<ClipperLib::cInt>::max();
+		box.right = box.bottom = std::numeric_limits<ClipperLib::cInt>::min();
+		BOOST_FOREACH(const ClipperLib::Path &path, paths) {
+			BOOST_FOREACH(const ClipperLib::IntPoint &p, path) {
+				box.left = std::min(box.left, p.X);
+				box.right = std::max(box.right, p.X);
+				box.top = std::min(box.top, p.Y);
+				box.bottom = std::max(box.bottom, p.Y);
+			}
+		}
+		return box;
+	}
+
+	// Interleaves the bits of x and y to a Z-order (Morton) code
+	static uint64_t mortonCode(uint32_t x, uint32_t y)
+	{
+		uint64_t code = 0;
+		for (int i = 0; i < 32; i++) {
+			code |= (uint64_t((x >> i) & 1) << (2*i)) | (uint64_t((y >> i) & 1) << (2*i + 1));
+		}
+		return code;
+	}
+
+	/*!
+		Orders operands along a Z-order curve through their bounding box
+		centers, so that operands close to each other end up in the same
+		subtree of the reduction and get merged early.
+	*/
+	static void sortSpatially(std::vector<const ClipperLib::Paths *> &items)
+	{
+		std::vector<ClipperLib::IntRect> boxes;
+		ClipperLib::IntRect total = getBoundingBox(ClipperLib::Paths());
+		BOOST_FOREACH(const ClipperLib::Paths *paths, items) {
+			boxes.push_back(getBoundingBox(*paths));
+			const ClipperLib::IntRect &box = boxes.back();
+			if (box.left > box.right) continue; // empty
+			total.left = std::min(total.left, box.left);
+			total.right = std::max(total.right, box.right);
+			total.top = std::min(total.top, box.top);
+			total.bottom = std::max(total.bottom, box.bottom);
+		}
+		if (total.left >= total.right || total.top >= total.bottom) return;
+
+		double sx = double(std::numeric_limits<uint32_t>::max()) / (double(total.right) - double(total.left));
+		double sy = double(std::numeric_limits<uint32_t>::max()) / (double(total.bottom) - double(total.top));
+		std::vector<std::pair<uint64_t, const ClipperLib::Paths *> > keyed;
+		for (size_t i = 0; i < items.size(); i++) {
+			const ClipperLib::IntRect &box = boxes[i];
+			uint64_t code = 0;
+			if (box.left <= box.right) {
+				double cx = (double(box.left) + double(box.right)) / 2 - double(total.left);
+				double cy = (double(box.top) + double(box.bottom)) / 2 - double(total.top);
+				code = mortonCode(uint32_t(cx * sx), uint32_t(cy * sy));
+			}
+			keyed.push_back(std::make_pair(code, items[i]));
+		}
+		std::stable_sort(keyed.begin(), keyed.end(), compareFirst);
+		for (size_t i = 0; i < items.size(); i++) items[i] = keyed[i].second;
+	}
+
+	/*!
+		Reduces items[begin, end) with the given operation by recursively
+		combining the results of both halves. Unions of small subsets are
+		done in a single Clipper pass.
+	*/
+	static ClipperLib::Paths reduce(const std::vector<const ClipperLib::Paths *> &items,
+																	size_t begin, size_t end, ClipperLib::ClipType clipType)
+	{
+		if (end - begin == 1) return *items[begin];
+
+		ClipperLib::Clipper clipper;
+		ClipperLib::Paths result;
+		if (clipType == ClipperLib::ctUnion && end - begin <= UNION_LEAF_SIZE) {
+			for (size_t i = begin; i < end; i++) {
+				clipper.AddPaths(*items[i], ClipperLib::ptSubject, true);
+			}
+		}
+		else {
+			size_t mid = begin + (end - begin) / 2;
+			clipper.AddPaths(reduce(items, begin, mid, clipType), ClipperLib::ptSubject, true);
+			clipper.AddPaths(reduce(items, mid, end, clipType), ClipperLib::ptClip, true);
+		}
+		clipper.Execute(clipType, result, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+		return result;
+	}
+
+	static void reduceTask(const std::vector<const ClipperLib::Paths *> &items,
+												 size_t begin, size_t end, ClipperLib::ClipType clipType,
+												 ClipperLib::Paths *result)
+	{
+		*result = reduce(items, begin, end, clipType);
+	}
+
+	/*!
+		Union or intersection of many operands. The operands are split into
+		one contiguous range per hardware thread, each range is reduced in
+		a balanced tree on its own thread, and the partial results are
+		combined into the final PolyTree.
+	*/
+	static void parallelReduce(std::vector<const ClipperLib::Paths *> &items,
+														 ClipperLib::ClipType clipType, ClipperLib::PolyTree &result)
+	{
+		if (clipType == ClipperLib::ctUnion) sortSpatially(items);
+
+		size_t numthreads = std::max(1u, boost::thread::hardware_concurrency());
+		numthreads = std::min(numthreads, std::max(size_t(1), items.size() / UNION_LEAF_SIZE));
+
+		std::vector<ClipperLib::Paths> partials(numthreads);
+		if (numthreads == 1) {
+			partials[0] = reduce(items, 0, items.size(), clipType);
+		}
+		else {
+			boost::thread_group threads;
+			for (size_t t = 0; t < numthreads; t++) {
+				size_t begin = items.size() * t / numthreads;
+				size_t end = items.size() * (t + 1) / numthreads;
+				threads.create_thread(boost::bind(&reduceTask, boost::cref(items), begin, end,
+																					clipType, &partials[t]));
+			}
+			threads.join_all();
+		}
+
+		std::vector<const ClipperLib::Paths *> partialptrs;
+		BOOST_FOREACH(const ClipperLib::Paths &paths, partials) partialptrs.push_back(&paths);
+		size_t mid = partialptrs.size() / 2;
+		ClipperLib::Clipper clipper;
+		if (mid == 0) {
+			clipper.AddPaths(partials[0], ClipperLib::ptSubject, true);
+			clipper.Execute(ClipperLib::ctUnion, result, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+		}
+		else {
+			clipper.AddPaths(reduce(partialptrs, 0, mid, clipType), ClipperLib::ptSubject, true);
+			clipper.AddPaths(reduce(partialptrs, mid, partialptrs.size(), clipType), ClipperLib::ptClip, true);
+			clipper.Execute(clipType, result, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+		}
+	}
+
 	Polygon2d *apply(const std::vector<ClipperLib::Paths> &pathsvector,
 									 ClipperLib::ClipType clipType)
 	{
 		ClipperLib::Clipper clipper;
 
+		if (pathsvector.size() >= REDUCTION_THRESHOLD) {
+			ClipperLib::PolyTree result;
+			if (clipType == ClipperLib::ctDifference) {
+				// Subtract the union of all the other operands
+				std::vector<const ClipperLib::Paths *> items;
+				for (size_t i = 1; i < pathsvector.size(); i++) items.push_back(&pathsvector[i]);
+				ClipperLib::PolyTree cliptree;
+				parallelReduce(items, ClipperLib::ctUnion, cliptree);
+				ClipperLib::Paths clippaths;
+				ClipperLib::PolyTreeToPaths(cliptree, clippaths);
+				clipper.AddPaths(pathsvector[0], ClipperLib::ptSubject, true);
+				clipper.AddPaths(clippaths, ClipperLib::ptClip, true);
+				clipper.Execute(clipType, result, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+			}
+			else {
+				std::vector<const ClipperLib::Paths *> items;
+				BOOST_FOREACH(const ClipperLib::Paths &paths, pathsvector) items.push_back(&paths);
+				parallelReduce(items, clipType, result);
+			}
+			if (clipType != ClipperLib::ctIntersection && result.Total() == 0) return NULL;
+			return ClipperUtils::toPolygon2d(result);
+		}
+
 		if (clipType == ClipperLib::ctIntersection && pathsvector.size() > 2) {
 			// intersection operations must be split into a sequence of binary operations
 			ClipperLib::Paths source = pathsvector[0];
@@ -197,6 +360,102 @@ namespace ClipperUtils {
 		}
 	}
 
+	/*!
+		Returns true if paths consists of a single convex outline. The
+		outline is returned in counter-clockwise order in convex_path.
+	*/
+	static bool isConvex(const ClipperLib::Paths &paths, ClipperLib::Path &convex_path)
+	{
+		if (paths.size() != 1 || paths[0].size() < 3) return false;
+		const ClipperLib::Path &path = paths[0];
+		size_t n = path.size();
+		int sign = 0;
+		for (size_t i = 0; i < n; i++) {
+			const ClipperLib::IntPoint &p0 = path[i];
+			const ClipperLib::IntPoint &p1 = path[(i+1)%n];
+			const ClipperLib::IntPoint &p2 = path[(i+2)%n];
+			long double cross = (long double)(p1.X - p0.X) * (p2.Y - p1.Y) - (long double)(p1.Y - p0.Y) * (p2.X - p1.X);
+			int s = (cross > 0) - (cross < 0);
+			if (s == 0) continue;
+			if (sign == 0) sign = s;
+			else if (s != sign) return false;
+		}
+		if (sign == 0) return false;
+		convex_path = path;
+		if (sign < 0) ClipperLib::ReversePath(convex_path);
+		return true;
+	}
+
+	// Index of the lowest (then leftmost) vertex
+	static size_t lowestVertex(const ClipperLib::Path &path)
+	{
+		size_t lowest = 0;
+		for (size_t i = 1; i < path.size(); i++) {
+			if (path[i].Y < path[lowest].Y ||
+					(path[i].Y == path[lowest].Y && path[i].X < path[lowest].X)) lowest = i;
+		}
+		return lowest;
+	}
+
+	// Orders edge vectors by their angle in [0, 2*pi)
+	static int compareAngle(const ClipperLib::IntPoint &a, const ClipperLib::IntPoint &b)
+	{
+		bool ha = a.Y < 0 || (a.Y == 0 && a.X < 0);
+		bool hb = b.Y < 0 || (b.Y == 0 && b.X < 0);
+		if (ha != hb) return ha ? 1 : -1;
+		long double cross = (long double)a.X * b.Y - (long double)a.Y * b.X;
+		return (cross < 0) - (cross > 0);
+	}
+
+	/*!
+		Minkowski sum of two convex, counter-clockwise paths in linear time by
+		merging their edges sorted by angle. q may also be a segment given as
+		two points.
+	*/
+	static ClipperLib::Path convexMinkowski(const ClipperLib::Path &p, const ClipperLib::Path &q)
+	{
+		size_t n = p.size(), m = q.size();
+		size_t i0 = lowestVertex(p), j0 = lowestVertex(q);
+		ClipperLib::Path result;
+		result.reserve(n + m);
+		size_t i = 0, j = 0;
+		while (i < n || j < m) {
+			const ClipperLib::IntPoint &pa = p[(i0 + i) % n], &pb = p[(i0 + i + 1) % n];
+			const ClipperLib::IntPoint &qa = q[(j0 + j) % m], &qb = q[(j0 + j + 1) % m];
+			result.push_back(ClipperLib::IntPoint(pa.X + qa.X, pa.Y + qa.Y));
+			int cmp = 0;
+			if (j == m) cmp = -1;
+			else if (i == n) cmp = 1;
+			else cmp = compareAngle(ClipperLib::IntPoint(pb.X - pa.X, pb.Y - pa.Y),
+															ClipperLib::IntPoint(qb.X - qa.X, qb.Y - qa.Y));
+			if (cmp <= 0) i++;
+			if (cmp >= 0) j++;
+		}
+		return result;
+	}
+
+	/*!
+		Minkowski sum of an arbitrary set of paths with a convex path: the
+		set translated by a point of the convex path, plus the convex path
+		swept along each edge of the set. Each sweep is a convex polygon
+		computed in linear time.
+	*/
+	static void convexMinkowskiTerms(const ClipperLib::Paths &paths, const ClipperLib::Path &convex,
+																	 ClipperLib::Paths &terms)
+	{
+		ClipperLib::Paths convexpaths(1, convex);
+		fill_minkowski_insides(paths, convexpaths, terms);
+		ClipperLib::Path segment(2);
+		BOOST_FOREACH(const ClipperLib::Path &path, paths) {
+			for (size_t i = 0; i < path.size(); i++) {
+				segment[0] = path[i];
+				segment[1] = path[(i+1) % path.size()];
+				if (segment[0] == segment[1]) continue;
+				terms.push_back(convexMinkowski(convex, segment));
+			}
+		}
+	}
+
 	Polygon2d *applyMinkowski(const std::vector<const Polygon2d*> &polygons)
 	{
 		if (polygons.size() == 1) return new Polygon2d(*polygons[0]); // Just copy
@@ -208,26 +467,43 @@ namespace ClipperUtils {
 			ClipperLib::Paths minkowski_terms;
 			ClipperLib::Paths rhs = ClipperUtils::fromPolygon2d(*polygons[i]);
 
-			// First, convolve each outline of lhs with the outlines of rhs
-			BOOST_FOREACH(ClipperLib::Path const& rhs_path, rhs) {
-				BOOST_FOREACH(ClipperLib::Path const& lhs_path, lhs) {
-					ClipperLib::Paths result;
-					minkowski_outline(lhs_path, rhs_path, result, true, true);
-					minkowski_terms.insert(minkowski_terms.end(), result.begin(), result.end());
-				}
+			ClipperLib::Path lhs_convex, rhs_convex;
+			bool lhs_is_convex = isConvex(lhs, lhs_convex);
+			bool rhs_is_convex = isConvex(rhs, rhs_convex);
+			if (lhs_is_convex && rhs_is_convex) {
+				// The sum of two convex polygons is convex; no union needed
+				minkowski_terms.push_back(convexMinkowski(lhs_convex, rhs_convex));
+			}
+			else if (lhs_is_convex) {
+				convexMinkowskiTerms(rhs, lhs_convex, minkowski_terms);
 			}
+			else if (rhs_is_convex) {
+				convexMinkowskiTerms(lhs, rhs_convex, minkowski_terms);
+			}
+			else {
+				// First, convolve each outline of lhs with the outlines of rhs
+				BOOST_FOREACH(ClipperLib::Path const& rhs_path, rhs) {
+					BOOST_FOREACH(ClipperLib::Path const& lhs_path, lhs) {
+						ClipperLib::Paths result;
+						minkowski_outline(lhs_path, rhs_path, result, true, true);
+						minkowski_terms.insert(minkowski_terms.end(), result.begin(), result.end());
+					}
+				}
 			
-			// Then, fill the central parts
-			fill_minkowski_insides(lhs, rhs, minkowski_terms);
-			fill_minkowski_insides(rhs, lhs, minkowski_terms);
+				// Then, fill the central parts
+				fill_minkowski_insides(lhs, rhs, minkowski_terms);
+				fill_minkowski_insides(rhs, lhs, minkowski_terms);
+			}
 
 			// This union operation must be performed at each interation since the minkowski_terms
 			// now contain lots of small quads
 			c.Clear();
 			c.AddPaths(minkowski_terms, ClipperLib::ptSubject, true);
 
-			if (i != polygons.size() - 1)
-				c.Execute(ClipperLib::ctUnion, lhs, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+			if (i != polygons.size() - 1) {
+				if (lhs_is_convex && rhs_is_convex) lhs = minkowski_terms;
+				else c.Execute(ClipperLib::ctUnion, lhs, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+			}
 		}
 
 		ClipperLib::PolyTree polytree;
@@ -99,20 +99,20 @@ shared_ptr<CSGTerm> CSGTerm::createCSGTerm(type_e type, CSGTerm *left, CSGTerm *
 }
 
 CSGTerm::CSGTerm(const shared_ptr<const Geometry> &geom, const Transform3d &matrix, const Color4f &color, const std::string &label)
-	: type(TYPE_PRIMITIVE), label(label), flag(CSGTerm::FLAG_NONE), m(matrix), color(color)
+	: type(TYPE_PRIMITIVE), label(label), flag(CSGTerm::FLAG_NONE), shared(false), hasnormalized(false), m(matrix), color(color)
 {
 	if (geom && !geom->isEmpty()) this->geom = geom;
 	initBoundingBox();
 }
 
 CSGTerm::CSGTerm(type_e type, shared_ptr<CSGTerm> left, shared_ptr<CSGTerm> right)
-	: type(type), left(left), right(right), flag(CSGTerm::FLAG_NONE), m(Transform3d::Identity())
+	: type(type), left(left), right(right), flag(CSGTerm::FLAG_NONE), shared(false), hasnormalized(false), m(Transform3d::Identity())
 {
 	initBoundingBox();
 }
 
 CSGTerm::CSGTerm(type_e type, CSGTerm *left, CSGTerm *right)
-	: type(type), left(left), right(right), flag(CSGTerm::FLAG_NONE), m(Transform3d::Identity())
+	: type(type), left(left), right(right), flag(CSGTerm::FLAG_NONE), shared(false), hasnormalized(false), m(Transform3d::Identity())
 {
 	initBoundingBox();
 }
@@ -121,6 +121,19 @@ CSGTerm::~CSGTerm()
 {
 }
 
+/*!
+	Returns a copy of this node which shares its children but is not
+	shared itself and hence may be modified.
+*/
+shared_ptr<CSGTerm> CSGTerm::clone() const
+{
+	shared_ptr<CSGTerm> t(new CSGTerm(*this));
+	t->shared = false;
+	t->hasnormalized = false;
+	t->normalized.reset();
+	return t;
+}
+
 void CSGTerm::initBoundingBox()
 {
 	if (this->type == TYPE_PRIMITIVE) {
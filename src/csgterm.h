@@ -34,10 +34,17 @@ public:
 	BoundingBox bbox;
 	Flag flag;
 
+	// Terms kept in the CSGTermCache are shared between compilations and
+	// must not be modified. CSGTermNormalizer memoizes their normal form.
+	bool shared;
+	bool hasnormalized;
+	shared_ptr<CSGTerm> normalized;
+
 	CSGTerm(const shared_ptr<const Geometry> &geom, const Transform3d &matrix, const Color4f &color, const std::string &label);
 	~CSGTerm();
 
 	const BoundingBox &getBoundingBox() const { return this->bbox; }
+	shared_ptr<CSGTerm> clone() const;
 
 	std::string dump();
 private:
@@ -16,21 +16,73 @@ static bool validate_tree(const shared_ptr<CSGTerm> &term)
 
 /*!
 	NB! for e.g. empty intersections, this can normalize a tree to nothing and return NULL.
+
+	Subtrees shared with the CSGTermCache are normalized on their own and
+	their normal form is memoized in the shared term. After a small edit,
+	only the subtrees on the path from the root to the change are normalized
+	again, and these start out from already normalized children.
 */
 shared_ptr<CSGTerm> CSGTermNormalizer::normalize(const shared_ptr<CSGTerm> &root)
 {
 	this->aborted = false;
+	shared_ptr<CSGTerm> temp = normalizeSubtree(root);
+	if (temp && !root->shared && !this->aborted) temp = normalizeTerm(temp);
+	return temp;
+}
+
+// Copies all operator nodes; primitives are never modified by the normalizer
+static shared_ptr<CSGTerm> copy_term(const shared_ptr<CSGTerm> &term)
+{
+	if (!term || term->type == CSGTerm::TYPE_PRIMITIVE) return term;
+	shared_ptr<CSGTerm> t = term->clone();
+	t->left = copy_term(term->left);
+	t->right = copy_term(term->right);
+	return t;
+}
+
+/*!
+	Returns a private copy of term in which all shared subtrees are replaced
+	by their normal form. normalizePass() rewrites children in place, so it
+	must never see a term which is reachable from the CSGTermCache.
+*/
+shared_ptr<CSGTerm> CSGTermNormalizer::normalizeSubtree(const shared_ptr<CSGTerm> &term)
+{
+	if (!term || term->type == CSGTerm::TYPE_PRIMITIVE) return term;
+	if (term->shared && term->hasnormalized) return copy_term(term->normalized);
+
+	shared_ptr<CSGTerm> left = normalizeSubtree(term->left);
+	shared_ptr<CSGTerm> right = normalizeSubtree(term->right);
+	shared_ptr<CSGTerm> t = CSGTerm::createCSGTerm(term->type, left, right);
+	if (t && t != left && t != right) t->flag = term->flag;
+
+	if (term->shared && !this->aborted) {
+		if (t) t = normalizeTerm(t);
+		if (!this->aborted) {
+			term->normalized = t;
+			term->hasnormalized = true;
+			return copy_term(t);
+		}
+	}
+	return t;
+}
+
+shared_ptr<CSGTerm> CSGTermNormalizer::normalizeTerm(const shared_ptr<CSGTerm> &root)
+{
 	shared_ptr<CSGTerm> temp = root;
 	while (1) {
 		this->rootnode = temp;
 		this->nodecount = 0;
 		shared_ptr<CSGTerm> n = normalizePass(temp);
-		if (!n) return n; // If normalized to nothing
+		if (!n) { // If normalized to nothing
+			temp = n;
+			break;
+		}
 		if (temp == n) break;
 		temp = n;
 
 		if (this->nodecount > this->limit) {
 			PRINTB("WARNING: Normalized tree is growing past %d elements. Aborting normalization.\n", this->limit);
+			this->aborted = true;
       // Clean up any partially evaluated terms
 			shared_ptr<CSGTerm> newroot = root, tmproot;
 			while (newroot && newroot != tmproot) {
@@ -38,6 +90,7 @@ shared_ptr<CSGTerm> CSGTermNormalizer::normalize(const shared_ptr<CSGTerm> &root
 				newroot = collapse_null_terms(tmproot);
 			}
 			newroot = cleanup_term(newroot);
+			this->rootnode.reset();
 			return newroot;
 		}
 	}
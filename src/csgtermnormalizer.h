@@ -11,6 +11,8 @@ public:
 	shared_ptr<class CSGTerm> normalize(const shared_ptr<CSGTerm> &term);
 
 private:
+	shared_ptr<CSGTerm> normalizeSubtree(const shared_ptr<CSGTerm> &term);
+	shared_ptr<CSGTerm> normalizeTerm(const shared_ptr<CSGTerm> &root);
 	shared_ptr<CSGTerm> normalizePass(shared_ptr<CSGTerm> term) ;
 	bool match_and_replace(shared_ptr<CSGTerm> &term);
 	shared_ptr<CSGTerm> collapse_null_terms(const shared_ptr<CSGTerm> &term);
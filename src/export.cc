@@ -32,6 +32,8 @@
 
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
 
 #define QUOTE(x__) # x__
 #define QUOTED(x__) QUOTE(x__)
@@ -40,6 +42,21 @@
 #include "CGAL_Nef_polyhedron.h"
 #include "cgal.h"
 #include "cgalutils.h"
+#include "GeometryEvaluator.h"
+#include "traverser.h"
+#include "visitor.h"
+#include "state.h"
+#include "module.h"
+#include "csgnode.h"
+#include "cgaladvnode.h"
+#include "rendernode.h"
+#include "transformnode.h"
+#include "grid.h"
+
+#include <ctime>
+#include <stdint.h>
+#include <boost/crc.hpp>
+#include <boost/unordered_map.hpp>
 
 struct triangle {
     std::string vs1;
@@ -61,6 +78,9 @@ void exportFile(const class Geometry *root_geom, std::ostream &output, FileForma
 		case OPENSCAD_AMF:
 			export_amf(N, output);
 			break;
+		case OPENSCAD_3MF:
+			export_3mf(N, output);
+			break;
 		case OPENSCAD_DXF:
 			assert(false && "Export Nef polyhedron as DXF not supported");
 			break;
@@ -80,6 +100,9 @@ void exportFile(const class Geometry *root_geom, std::ostream &output, FileForma
 			case OPENSCAD_AMF:
 				export_amf(*ps, output);
 				break;
+			case OPENSCAD_3MF:
+				export_3mf(*ps, output);
+				break;
 			default:
 				assert(false && "Unsupported file format");
 			}
@@ -101,17 +124,19 @@ void exportFile(const class Geometry *root_geom, std::ostream &output, FileForma
 	}
 }
 
-void exportFileByName(const class Geometry *root_geom, FileFormat format,
+static void exportToFile(boost::function<void (std::ostream &)> writer, FileFormat format,
 	const char *name2open, const char *name2display)
 {
-	std::ofstream fstream(name2open);
+	std::ios::openmode mode = std::ios::out;
+	if (format == OPENSCAD_3MF) mode |= std::ios::binary;
+	std::ofstream fstream(name2open, mode);
 	if (!fstream.is_open()) {
 		PRINTB("Can't open file \"%s\" for export", name2display);
 	} else {
 		bool onerror = false;
 		fstream.exceptions(std::ios::badbit|std::ios::failbit);
 		try {
-			exportFile(root_geom, fstream, format);
+			writer(fstream);
 		} catch (std::ios::failure x) {
 			onerror = true;
 		}
@@ -126,6 +151,28 @@ void exportFileByName(const class Geometry *root_geom, FileFormat format,
 	}
 }
 
+void exportFileByName(const class Geometry *root_geom, FileFormat format,
+	const char *name2open, const char *name2display)
+{
+	exportToFile(boost::bind(&exportFile, root_geom, _1, format), format, name2open, name2display);
+}
+
+/*!
+	Exports the top-level objects of the tree. Only 3MF can make use of the
+	tree structure; the other formats export the given root geometry.
+ */
+void exportFileByName(Tree &tree, const class Geometry *root_geom, FileFormat format,
+	const char *name2open, const char *name2display)
+{
+	if (format == OPENSCAD_3MF && tree.root()) {
+		void (*export_tree)(Tree &, std::ostream &) = &export_3mf;
+		exportToFile(boost::bind(export_tree, boost::ref(tree), _1), format, name2open, name2display);
+	}
+	else {
+		exportFileByName(root_geom, format, name2open, name2display);
+	}
+}
+
 void export_stl(const PolySet &ps, std::ostream &output)
 {
 	PolySet triangulated(3);
@@ -251,12 +298,8 @@ void export_stl(const CGAL_Nef_polyhedron *root_N, std::ostream &output)
 
 	bool usePolySet = true;
 	if (usePolySet) {
-		PolySet ps(3);
-		bool err = CGALUtils::createPolySetFromNefPolyhedron3(*(root_N->p3), ps);
-		if (err) { PRINT("ERROR: Nef->PolySet failed"); }
-		else {
-			export_stl(ps, output);
-		}
+		shared_ptr<const PolySet> ps = root_N->getMesh();
+		if (ps) export_stl(*ps, output);
 	}
 	else {
 		CGAL::Failure_behaviour old_behaviour = CGAL::set_error_behaviour(CGAL::THROW_EXCEPTION);
@@ -433,6 +476,445 @@ void export_amf(const CGAL_Nef_polyhedron *root_N, std::ostream &output)
 	setlocale(LC_NUMERIC, ""); // Set default locale
 }
 
+/*!
+	Minimal zip writer for 3MF packages.
+
+	Entries are stored uncompressed and streamed straight into the output
+	stream while their CRC is computed. On seekable streams the sizes and
+	CRC are patched into the local header afterwards; otherwise they follow
+	the entry data in a data descriptor. Zip64 is not supported, so neither
+	an entry nor the package may exceed 4GB.
+ */
+class ZipWriter
+{
+public:
+	ZipWriter(std::ostream &output) : output(output), entrybuf(output), entry(&entrybuf), pos(0) {
+		this->base = output.tellp();
+		this->seekable = (this->base != std::streampos(-1));
+		time_t now = time(NULL);
+		struct tm *t = localtime(&now);
+		this->dostime = (t->tm_hour << 11) | (t->tm_min << 5) | (t->tm_sec / 2);
+		this->dosdate = ((t->tm_year - 80) << 9) | ((t->tm_mon + 1) << 5) | t->tm_mday;
+	}
+
+	/*! Starts a new entry and returns the stream to write its contents to. */
+	std::ostream &beginEntry(const std::string &name) {
+		Entry e;
+		e.name = name;
+		e.offset = this->pos;
+		e.crc = 0;
+		e.size = 0;
+		this->entries.push_back(e);
+
+		put32(0x04034b50);
+		put16(20);          // version needed to extract
+		put16(flags());
+		put16(0);           // stored
+		put16(this->dostime);
+		put16(this->dosdate);
+		put32(0);           // crc, patched in endEntry()
+		put32(0);           // compressed size
+		put32(0);           // uncompressed size
+		put16(name.size());
+		put16(0);           // extra field length
+		this->output.write(name.data(), name.size());
+		this->pos += 30 + name.size();
+
+		this->entrybuf.reset();
+		return this->entry;
+	}
+
+	void endEntry() {
+		this->entry.flush();
+		Entry &e = this->entries.back();
+		e.crc = this->entrybuf.checksum();
+		e.size = this->entrybuf.size();
+		this->pos += e.size;
+		if (this->seekable) {
+			this->output.seekp(this->base + std::streamoff(e.offset + 14));
+			put32(e.crc);
+			put32(e.size);
+			put32(e.size);
+			this->output.seekp(this->base + std::streamoff(this->pos));
+		}
+		else {
+			put32(0x08074b50);
+			put32(e.crc);
+			put32(e.size);
+			put32(e.size);
+			this->pos += 16;
+		}
+	}
+
+	/*! Writes the central directory. Returns false if the package got too large. */
+	bool finish() {
+		uint64_t cdoffset = this->pos;
+		BOOST_FOREACH(const Entry &e, this->entries) {
+			put32(0x02014b50);
+			put16(20);          // version made by
+			put16(20);          // version needed to extract
+			put16(flags());
+			put16(0);           // stored
+			put16(this->dostime);
+			put16(this->dosdate);
+			put32(e.crc);
+			put32(e.size);
+			put32(e.size);
+			put16(e.name.size());
+			put16(0);           // extra field length
+			put16(0);           // comment length
+			put16(0);           // disk number
+			put16(0);           // internal attributes
+			put32(0);           // external attributes
+			put32(e.offset);
+			this->output.write(e.name.data(), e.name.size());
+			this->pos += 46 + e.name.size();
+		}
+		put32(0x06054b50);
+		put16(0);
+		put16(0);
+		put16(this->entries.size());
+		put16(this->entries.size());
+		put32(this->pos - cdoffset);
+		put32(cdoffset);
+		put16(0);           // comment length
+		return this->pos <= 0xffffffffu;
+	}
+
+private:
+	/*! Forwards written bytes to the archive while keeping a running CRC-32 */
+	class EntryBuffer : public std::streambuf
+	{
+	public:
+		EntryBuffer(std::ostream &output) : output(output), written(0) {
+			setp(this->buffer, this->buffer + sizeof(this->buffer));
+		}
+		void reset() {
+			this->crc.reset();
+			this->written = 0;
+		}
+		uint32_t checksum() const { return this->crc.checksum(); }
+		uint64_t size() const { return this->written; }
+
+	protected:
+		virtual int overflow(int c) {
+			flushBuffer();
+			if (c != traits_type::eof()) {
+				*pptr() = traits_type::to_char_type(c);
+				pbump(1);
+			}
+			return traits_type::not_eof(c);
+		}
+		virtual int sync() {
+			flushBuffer();
+			return 0;
+		}
+
+	private:
+		void flushBuffer() {
+			std::ptrdiff_t n = pptr() - pbase();
+			if (n > 0) {
+				this->crc.process_bytes(pbase(), n);
+				this->output.write(pbase(), n);
+				this->written += n;
+			}
+			setp(this->buffer, this->buffer + sizeof(this->buffer));
+		}
+
+		std::ostream &output;
+		boost::crc_32_type crc;
+		uint64_t written;
+		char buffer[64*1024];
+	};
+
+	struct Entry {
+		std::string name;
+		uint64_t offset;
+		uint32_t crc;
+		uint64_t size;
+	};
+
+	uint16_t flags() const { return this->seekable ? 0 : 0x0008; }
+
+	void put16(uint16_t v) {
+		char b[2] = { char(v & 0xff), char(v >> 8) };
+		this->output.write(b, 2);
+	}
+
+	void put32(uint32_t v) {
+		char b[4] = { char(v & 0xff), char((v >> 8) & 0xff), char((v >> 16) & 0xff), char(v >> 24) };
+		this->output.write(b, 4);
+	}
+
+	std::ostream &output;
+	EntryBuffer entrybuf;
+	std::ostream entry;
+	std::streampos base;
+	bool seekable;
+	uint64_t pos;
+	uint16_t dostime, dosdate;
+	std::vector<Entry> entries;
+};
+
+typedef std::vector<Transform3d, Eigen::aligned_allocator<Transform3d> > Transform3dList;
+
+/*!
+	Collects the top-level objects of a tree as 3MF build items.
+
+	Implicit unions (groups, union() and transformations) are descended
+	into; every other node becomes an instance of the object identified
+	by its tree ID string, so identical subtrees (and thus identical cached
+	geometry) share a single mesh resource.
+ */
+class InstanceCollector : public Visitor
+{
+public:
+	InstanceCollector(const Tree &tree) : tree(tree) {}
+
+	virtual Response visit(State &state, const AbstractNode &node) {
+		if (node.modinst->isBackground()) return PruneTraversal;
+		return ContinueTraversal;
+	}
+	virtual Response visit(State &state, const AbstractIntersectionNode &node) {
+		return addInstance(state, node);
+	}
+	virtual Response visit(State &state, const AbstractPolyNode &node) {
+		return addInstance(state, node);
+	}
+	virtual Response visit(State &state, const CgaladvNode &node) {
+		return addInstance(state, node);
+	}
+	virtual Response visit(State &state, const RenderNode &node) {
+		return addInstance(state, node);
+	}
+	virtual Response visit(State &state, const CsgNode &node) {
+		if (node.type != OPENSCAD_UNION) return addInstance(state, node);
+		return visit(state, (const AbstractNode &)node);
+	}
+	virtual Response visit(State &state, const TransformNode &node) {
+		if (node.modinst->isBackground()) return PruneTraversal;
+		if (matrix_contains_infinity(node.matrix) || matrix_contains_nan(node.matrix)) {
+			return PruneTraversal;
+		}
+		state.setMatrix(state.matrix() * node.matrix);
+		return ContinueTraversal;
+	}
+
+	std::vector<const AbstractNode *> objects;
+	std::vector<size_t> items;
+	Transform3dList transforms;
+
+private:
+	Response addInstance(const State &state, const AbstractNode &node) {
+		if (node.modinst->isBackground()) return PruneTraversal;
+		const std::string &key = this->tree.getIdString(node);
+		boost::unordered_map<std::string, size_t>::iterator it = this->objectids.find(key);
+		if (it == this->objectids.end()) {
+			it = this->objectids.insert(std::make_pair(key, this->objects.size())).first;
+			this->objects.push_back(&node);
+		}
+		this->items.push_back(it->second);
+		this->transforms.push_back(state.matrix());
+		return PruneTraversal;
+	}
+
+	const Tree &tree;
+	boost::unordered_map<std::string, size_t> objectids;
+};
+
+/*!
+	Writes the given polyset as a 3MF object resource with indexed vertices.
+	If bake is given, the vertices are transformed by it, reversing the
+	triangle winding for mirroring transforms.
+ */
+static void write_3mf_object(std::ostream &output, size_t id, const PolySet &ps,
+														 const Transform3d *bake)
+{
+	PolySet triangulated(3);
+	PolysetUtils::tessellate_faces(ps, triangulated);
+	bool flip = bake && bake->matrix().determinant() < 0;
+
+	output << " <object id=\"" << id << "\" type=\"model\">\n"
+				 << "  <mesh>\n"
+				 << "   <vertices>\n";
+	Grid3d<int> grid(GRID_FINE);
+	int numvertices = 0;
+	BOOST_FOREACH(const PolySet::Polygon &p, triangulated.polygons) {
+		BOOST_FOREACH(Vector3d v, p) {
+			if (bake) v = *bake * v;
+			if (!grid.has(v[0], v[1], v[2])) {
+				grid.align(v[0], v[1], v[2]) = numvertices++;
+				output << "    <vertex x=\"" << v[0] << "\" y=\"" << v[1] << "\" z=\"" << v[2] << "\"/>\n";
+			}
+		}
+	}
+	output << "   </vertices>\n"
+				 << "   <triangles>\n";
+	BOOST_FOREACH(const PolySet::Polygon &p, triangulated.polygons) {
+		assert(p.size() == 3);
+		int idx[3];
+		for (int i=0;i<3;i++) {
+			Vector3d v = bake ? Vector3d(*bake * p[i]) : p[i];
+			idx[i] = grid.data(v[0], v[1], v[2]);
+		}
+		if (idx[0] == idx[1] || idx[0] == idx[2] || idx[1] == idx[2]) continue;
+		if (flip) std::swap(idx[1], idx[2]);
+		output << "    <triangle v1=\"" << idx[0] << "\" v2=\"" << idx[1] << "\" v3=\"" << idx[2] << "\"/>\n";
+	}
+	output << "   </triangles>\n"
+				 << "  </mesh>\n"
+				 << " </object>\n";
+}
+
+/*!
+	Writes a 3MF package. objects holds the distinct meshes; each build
+	item references one of them by index together with its placement.
+	Items with mirroring transforms get a baked copy of their mesh, as 3MF
+	consumers expect positively oriented build item transforms.
+ */
+static void export_3mf(const std::vector<shared_ptr<const PolySet> > &objects,
+											 const std::vector<size_t> &items, const Transform3dList &transforms,
+											 std::ostream &output)
+{
+	setlocale(LC_NUMERIC, "C"); // Ensure radix is . (not ,) in output
+
+	ZipWriter zip(output);
+	std::ostream &types = zip.beginEntry("[Content_Types].xml");
+	types << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+				<< "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">\n"
+				<< " <Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>\n"
+				<< " <Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\"/>\n"
+				<< "</Types>\n";
+	zip.endEntry();
+
+	std::ostream &rels = zip.beginEntry("_rels/.rels");
+	rels << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			 << "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">\n"
+			 << " <Relationship Target=\"/3D/3dmodel.model\" Id=\"rel0\" Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\"/>\n"
+			 << "</Relationships>\n";
+	zip.endEntry();
+
+	std::ostream &model = zip.beginEntry("3D/3dmodel.model");
+	model << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+				<< "<model unit=\"millimeter\" xml:lang=\"en-US\" xmlns=\"http://schemas.microsoft.com/3dmanufacturing/core/2015/02\">\n"
+				<< "<metadata name=\"Application\">OpenSCAD " << QUOTED(OPENSCAD_VERSION)
+#ifdef OPENSCAD_COMMIT
+				<< " (git " << QUOTED(OPENSCAD_COMMIT) << ")"
+#endif
+				<< "</metadata>\n"
+				<< "<resources>\n";
+
+	// Object ids are 1-based. Items with mirroring transforms get a baked
+	// copy of their mesh with an id after the shared ones.
+	std::vector<size_t> itemids(items.size());
+	std::vector<bool> shared(objects.size(), false);
+	for (size_t j=0;j<items.size();j++) {
+		if (transforms[j].matrix().determinant() >= 0) shared[items[j]] = true;
+	}
+	for (size_t i=0;i<objects.size();i++) {
+		if (shared[i]) write_3mf_object(model, i + 1, *objects[i], NULL);
+	}
+	size_t nextid = objects.size() + 1;
+	for (size_t j=0;j<items.size();j++) {
+		if (transforms[j].matrix().determinant() < 0) {
+			itemids[j] = nextid;
+			write_3mf_object(model, nextid++, *objects[items[j]], &transforms[j]);
+		}
+		else {
+			itemids[j] = items[j] + 1;
+		}
+	}
+
+	model << "</resources>\n"
+				<< "<build>\n";
+	for (size_t j=0;j<items.size();j++) {
+		model << " <item objectid=\"" << itemids[j] << "\"";
+		const Transform3d &m = transforms[j];
+		if (m.matrix().determinant() >= 0 && !m.matrix().isIdentity()) {
+			// 3MF uses row vectors: the last row holds the translation
+			model << " transform=\"";
+			for (int col=0;col<4;col++) {
+				for (int row=0;row<3;row++) {
+					model << m(row, col) << ((col == 3 && row == 2) ? "" : " ");
+				}
+			}
+			model << "\"";
+		}
+		model << "/>\n";
+	}
+	model << "</build>\n"
+				<< "</model>\n";
+	zip.endEntry();
+
+	if (!zip.finish()) {
+		PRINT("ERROR: 3MF package exceeds 4GB and cannot be written without Zip64 support");
+	}
+	setlocale(LC_NUMERIC, ""); // Set default locale
+}
+
+void export_3mf(const PolySet &ps, std::ostream &output)
+{
+	std::vector<shared_ptr<const PolySet> > objects;
+	objects.push_back(shared_ptr<const PolySet>(new PolySet(ps)));
+	std::vector<size_t> items(1, 0);
+	Transform3dList transforms(1, Transform3d::Identity());
+	export_3mf(objects, items, transforms, output);
+}
+
+void export_3mf(const CGAL_Nef_polyhedron *root_N, std::ostream &output)
+{
+	if (!root_N->p3->is_simple()) {
+		PRINT("Warning: Exported object may not be a valid 2-manifold and may need repair");
+	}
+	shared_ptr<const PolySet> ps = root_N->getMesh();
+	if (ps) export_3mf(*ps, output);
+}
+
+/*!
+	Exports the top-level objects of the given tree as a 3MF package.
+	Identical subtrees are written once as a shared mesh and referenced by
+	one build item per placement. The geometry is taken from the geometry
+	caches, so this is cheap after the tree has been rendered.
+ */
+void export_3mf(Tree &tree, std::ostream &output)
+{
+	InstanceCollector collector(tree);
+	Traverser trav(collector, *tree.root(), Traverser::PREFIX);
+	trav.execute();
+
+	GeometryEvaluator geomevaluator(tree);
+	std::vector<shared_ptr<const PolySet> > objects(collector.objects.size());
+	bool skipped2d = false;
+	for (size_t i=0;i<collector.objects.size();i++) {
+		shared_ptr<const Geometry> geom = geomevaluator.evaluateGeometry(*collector.objects[i], false);
+		if (!geom || geom->isEmpty()) continue;
+		if (geom->getDimension() != 3) {
+			skipped2d = true;
+			continue;
+		}
+		objects[i] = dynamic_pointer_cast<const PolySet>(geom);
+	}
+	if (skipped2d) PRINT("Warning: 2D objects are not exported to 3MF.");
+
+	// Drop items whose object turned out empty and compact the object list
+	std::vector<shared_ptr<const PolySet> > usedobjects;
+	std::vector<size_t> remap(objects.size(), size_t(-1));
+	std::vector<size_t> items;
+	Transform3dList transforms;
+	for (size_t j=0;j<collector.items.size();j++) {
+		size_t obj = collector.items[j];
+		if (!objects[obj]) continue;
+		if (remap[obj] == size_t(-1)) {
+			remap[obj] = usedobjects.size();
+			usedobjects.push_back(objects[obj]);
+		}
+		items.push_back(remap[obj]);
+		transforms.push_back(collector.transforms[j]);
+	}
+	PRINTB("3MF export: %d build items sharing %d meshes", items.size() % usedobjects.size());
+	export_3mf(usedobjects, items, transforms, output);
+}
+
 #endif // ENABLE_CGAL
 
 /*!
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <vector>
 #include "Tree.h"
 #include "Camera.h"
 #include "memory.h"
@@ -11,6 +12,7 @@ enum FileFormat {
 	OPENSCAD_STL,
 	OPENSCAD_OFF,
 	OPENSCAD_AMF,
+	OPENSCAD_3MF,
 	OPENSCAD_DXF,
 	OPENSCAD_SVG
 };
@@ -18,7 +20,10 @@ enum FileFormat {
 // void exportFile(const class Geometry *root_geom, std::ostream &output, FileFormat format);
 void exportFileByName(const class Geometry *root_geom, FileFormat format,
 	const char *name2open, const char *name2display);
+void exportFileByName(Tree &tree, const class Geometry *root_geom, FileFormat format,
+	const char *name2open, const char *name2display);
 void export_png(shared_ptr<const class Geometry> root_geom, Camera &c, std::ostream &output);
+void export_png(shared_ptr<const class Geometry> root_geom, std::vector<Camera> &cams, const std::vector<std::ostream *> &outputs);
 
 void export_stl(const class CGAL_Nef_polyhedron *root_N, std::ostream &output);
 void export_stl(const class PolySet &ps, std::ostream &output);
@@ -26,11 +31,16 @@ void export_off(const CGAL_Nef_polyhedron *root_N, std::ostream &output);
 void export_off(const class PolySet &ps, std::ostream &output);
 void export_amf(const class CGAL_Nef_polyhedron *root_N, std::ostream &output);
 void export_amf(const class PolySet &ps, std::ostream &output);
+void export_3mf(const class CGAL_Nef_polyhedron *root_N, std::ostream &output);
+void export_3mf(const class PolySet &ps, std::ostream &output);
+void export_3mf(Tree &tree, std::ostream &output);
 void export_dxf(const class Polygon2d &poly, std::ostream &output);
 void export_svg(const class Polygon2d &poly, std::ostream &output);
 void export_png(const CGAL_Nef_polyhedron *root_N, Camera &c, std::ostream &output);
 void export_png_with_opencsg(Tree &tree, Camera &c, std::ostream &output);
+void export_png_with_opencsg(Tree &tree, std::vector<Camera> &cams, const std::vector<std::ostream *> &outputs);
 void export_png_with_throwntogether(Tree &tree, Camera &c, std::ostream &output);
+void export_png_with_throwntogether(Tree &tree, std::vector<Camera> &cams, const std::vector<std::ostream *> &outputs);
 
 #endif // ENABLE_CGAL
 
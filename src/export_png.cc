@@ -3,6 +3,7 @@
 #include "OffscreenView.h"
 #include "CsgInfo.h"
 #include <stdio.h>
+#include <assert.h>
 #include "polyset.h"
 #include "rendersettings.h"
 
@@ -11,6 +12,11 @@
 #include "cgal.h"
 #include "cgalutils.h"
 #include "CGAL_Nef_polyhedron.h"
+#include "SoftwareRasterizer.h"
+#include <algorithm>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 
 static void setupCamera(Camera &cam, const BoundingBox &bbox, float scalefactor)
 {
@@ -19,12 +25,93 @@ static void setupCamera(Camera &cam, const BoundingBox &bbox, float scalefactor)
 	if (cam.viewall) cam.viewAll(bbox, scalefactor);
 }
 
+static const ColorScheme &renderColorScheme()
+{
+	const ColorScheme *cs = ColorMap::inst()->findColorScheme(RenderSettings::inst()->colorscheme);
+	return cs ? *cs : ColorMap::inst()->defaultColorScheme();
+}
+
+struct SoftwareViewJobs {
+	const SoftwareRasterizer *rasterizer;
+	const std::vector<Camera> *cams;
+	const std::vector<std::ostream *> *outputs;
+	unsigned int threads_per_view;
+
+	boost::mutex mutex;
+	size_t next;
+};
+
+static void software_view_worker(SoftwareViewJobs &jobs)
+{
+	while (true) {
+		size_t i;
+		{
+			boost::mutex::scoped_lock lock(jobs.mutex);
+			if (jobs.next == jobs.cams->size()) return;
+			i = jobs.next++;
+		}
+		if (!jobs.rasterizer->save((*jobs.cams)[i], *(*jobs.outputs)[i], jobs.threads_per_view)) {
+			fprintf(stderr,"Can't write PNG image.\n");
+		}
+	}
+}
+
+/*!
+	Renders all views from one tessellation of the geometry. Views are
+	rendered in parallel, with the hardware threads split between them.
+*/
+static void export_png_software(shared_ptr<const Geometry> root_geom, std::vector<Camera> &cams, const std::vector<std::ostream *> &outputs)
+{
+	PRINTD("export_png_software");
+	SoftwareRasterizer rasterizer(root_geom, renderColorScheme());
+	BOOST_FOREACH(Camera &cam, cams) setupCamera(cam, rasterizer.getBoundingBox(), 3);
+
+	unsigned int nthreads = std::max(1u, boost::thread::hardware_concurrency());
+	unsigned int nworkers = std::min<size_t>(nthreads, cams.size());
+
+	SoftwareViewJobs jobs;
+	jobs.rasterizer = &rasterizer;
+	jobs.cams = &cams;
+	jobs.outputs = &outputs;
+	jobs.threads_per_view = std::max(1u, nthreads / std::max(1u, nworkers));
+	jobs.next = 0;
+
+	if (nworkers > 1) {
+		boost::thread_group threads;
+		for (unsigned int i = 0; i < nworkers; i++) {
+			threads.create_thread(boost::bind(&software_view_worker, boost::ref(jobs)));
+		}
+		threads.join_all();
+	}
+	else {
+		software_view_worker(jobs);
+	}
+}
+
 void export_png(shared_ptr<const Geometry> root_geom, Camera &cam, std::ostream &output)
+{
+	std::vector<Camera> cams(1, cam);
+	std::vector<std::ostream *> outputs(1, &output);
+	export_png(root_geom, cams, outputs);
+	cam = cams[0];
+}
+
+/*!
+	Renders one image per camera into the corresponding output stream,
+	sharing the renderer and the offscreen context between all views.
+*/
+void export_png(shared_ptr<const Geometry> root_geom, std::vector<Camera> &cams, const std::vector<std::ostream *> &outputs)
 {
 	PRINTD("export_png geom");
+	assert(cams.size() == outputs.size());
+	if (cams.empty()) return;
+	if (RenderSettings::inst()->backend == RenderSettings::SOFTWARE) {
+		export_png_software(root_geom, cams, outputs);
+		return;
+	}
 	OffscreenView *glview;
 	try {
-		glview = new OffscreenView(cam.pixel_width, cam.pixel_height);
+		glview = new OffscreenView(cams[0].pixel_width, cams[0].pixel_height);
 	} catch (int error) {
 		fprintf(stderr,"Can't create OpenGL OffscreenView. Code: %i.\n", error);
 		return;
@@ -32,13 +119,15 @@ void export_png(shared_ptr<const Geometry> root_geom, Camera &cam, std::ostream
 	CGALRenderer cgalRenderer(root_geom);
 
 	BoundingBox bbox = cgalRenderer.getBoundingBox();
-	setupCamera(cam, bbox, 3);
-
-	glview->setCamera(cam);
 	glview->setRenderer(&cgalRenderer);
 	glview->setColorScheme(RenderSettings::inst()->colorscheme);
-	glview->paintGL();
-	glview->save(output);
+
+	for (size_t i = 0; i < cams.size(); i++) {
+		setupCamera(cams[i], bbox, 3);
+		glview->setCamera(cams[i]);
+		glview->paintGL();
+		glview->save(*outputs[i]);
+	}
 }
 
 enum Previewer { OPENCSG, THROWNTOGETHER } previewer;
@@ -49,9 +138,11 @@ enum Previewer { OPENCSG, THROWNTOGETHER } previewer;
 #endif
 #include "ThrownTogetherRenderer.h"
 
-void export_png_preview_common(Tree &tree, Camera &cam, std::ostream &output, Previewer previewer = OPENCSG)
+void export_png_preview_common(Tree &tree, std::vector<Camera> &cams, const std::vector<std::ostream *> &outputs, Previewer previewer = OPENCSG)
 {
 	PRINTD("export_png_preview_common");
+	assert(cams.size() == outputs.size());
+	if (cams.empty()) return;
 	CsgInfo csgInfo = CsgInfo();
 	if (!csgInfo.compile_chains(tree)) {
 		fprintf(stderr,"Couldn't initialize CSG chains\n");
@@ -59,7 +150,7 @@ void export_png_preview_common(Tree &tree, Camera &cam, std::ostream &output, Pr
 	}
 
 	try {
-		csgInfo.glview = new OffscreenView(cam.pixel_width, cam.pixel_height);
+		csgInfo.glview = new OffscreenView(cams[0].pixel_width, cams[0].pixel_height);
 	} catch (int error) {
 		fprintf(stderr,"Can't create OpenGL OffscreenView. Code: %i.\n", error);
 		return;
@@ -78,31 +169,51 @@ void export_png_preview_common(Tree &tree, Camera &cam, std::ostream &output, Pr
 		csgInfo.glview->setRenderer(&thrownTogetherRenderer);
 #ifdef ENABLE_OPENCSG
 	BoundingBox bbox = csgInfo.glview->getRenderer()->getBoundingBox();
-	setupCamera(cam, bbox, 2.7);
-
-	csgInfo.glview->setCamera(cam);
 	OpenCSG::setContext(0);
 	OpenCSG::setOption(OpenCSG::OffscreenSetting, OpenCSG::FrameBufferObject);
 #endif
 	csgInfo.glview->setColorScheme(RenderSettings::inst()->colorscheme);
-	csgInfo.glview->paintGL();
-	csgInfo.glview->save(output);
+
+	for (size_t i = 0; i < cams.size(); i++) {
+#ifdef ENABLE_OPENCSG
+		setupCamera(cams[i], bbox, 2.7);
+		csgInfo.glview->setCamera(cams[i]);
+#endif
+		csgInfo.glview->paintGL();
+		csgInfo.glview->save(*outputs[i]);
+	}
 }
 
-void export_png_with_opencsg(Tree &tree, Camera &cam, std::ostream &output)
+void export_png_with_opencsg(Tree &tree, std::vector<Camera> &cams, const std::vector<std::ostream *> &outputs)
 {
 	PRINTD("export_png_w_opencsg");
 #ifdef ENABLE_OPENCSG
-	export_png_preview_common(tree, cam, output, OPENCSG);
+	export_png_preview_common(tree, cams, outputs, OPENCSG);
 #else
 	fprintf(stderr,"This openscad was built without OpenCSG support\n");
 #endif
 }
 
-void export_png_with_throwntogether(Tree &tree, Camera &cam, std::ostream &output)
+void export_png_with_opencsg(Tree &tree, Camera &cam, std::ostream &output)
+{
+	std::vector<Camera> cams(1, cam);
+	std::vector<std::ostream *> outputs(1, &output);
+	export_png_with_opencsg(tree, cams, outputs);
+	cam = cams[0];
+}
+
+void export_png_with_throwntogether(Tree &tree, std::vector<Camera> &cams, const std::vector<std::ostream *> &outputs)
 {
 	PRINTD("export_png_w_thrown");
-	export_png_preview_common(tree, cam, output, THROWNTOGETHER);
+	export_png_preview_common(tree, cams, outputs, THROWNTOGETHER);
+}
+
+void export_png_with_throwntogether(Tree &tree, Camera &cam, std::ostream &output)
+{
+	std::vector<Camera> cams(1, cam);
+	std::vector<std::ostream *> outputs(1, &output);
+	export_png_with_throwntogether(tree, cams, outputs);
+	cam = cams[0];
 }
 
 #endif // ENABLE_CGAL
@@ -32,6 +32,8 @@
 #include "evalcontext.h"
 #include "builtin.h"
 #include "dxfdata.h"
+#include "svgimport.h"
+#include "ImportCache.h"
 #include "printutils.h"
 #include "fileutils.h"
 #include "handle_dep.h" // handle_dep()
@@ -106,6 +108,7 @@ AbstractNode *ImportModule::instantiate(const Context *ctx, const ModuleInstanti
 		if (ext == ".stl") actualtype = TYPE_STL;
 		else if (ext == ".off") actualtype = TYPE_OFF;
 		else if (ext == ".dxf") actualtype = TYPE_DXF;
+		else if (ext == ".svg") actualtype = TYPE_SVG;
 	}
 
 	ImportNode *node = new ImportNode(inst, actualtype);
@@ -183,9 +186,32 @@ void read_stl_facet( std::ifstream &f, stl_facet &facet )
 }
 
 /*!
-	Will return an empty geometry if the import failed, but not NULL
+	Will return an empty geometry if the import failed, but not NULL.
+	Parsed files are shared between all import nodes through the ImportCache.
 */
 Geometry *ImportNode::createGeometry() const
+{
+	std::stringstream params;
+	params << this->type << "|" << this->layername << "|" << this->origin_x << "|" << this->origin_y
+				 << "|" << this->scale << "|" << this->fn << "|" << this->fs << "|" << this->fa;
+	std::string key = ImportCache::makeKey(this->filename, params.str());
+
+	Geometry *g = NULL;
+	shared_ptr<const Geometry> cached = ImportCache::instance()->get(key);
+	if (cached) {
+		handle_dep((std::string)this->filename);
+		g = cached->copy();
+	}
+	else {
+		g = readGeometry();
+		ImportCache::instance()->insert(key, shared_ptr<const Geometry>(g->copy()));
+	}
+
+	g->setConvexity(this->convexity);
+	return g;
+}
+
+Geometry *ImportNode::readGeometry() const
 {
 	Geometry *g = NULL;
 
@@ -299,12 +325,15 @@ Geometry *ImportNode::createGeometry() const
 		g = dd.toPolygon2d();
 	}
 		break;
+	case TYPE_SVG: {
+		g = import_svg(this->fn, this->fs, this->fa, this->filename, this->origin_x, this->origin_y, this->scale);
+	}
+		break;
 	default:
 		PRINTB("ERROR: Unsupported file format while trying to import file '%s'", this->filename);
 		g = new PolySet(0);
 	}
 
-	if (g) g->setConvexity(this->convexity);
 	return g;
 }
 
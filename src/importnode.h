@@ -8,7 +8,8 @@ enum import_type_e {
 	TYPE_UNKNOWN,
 	TYPE_STL,
 	TYPE_OFF,
-	TYPE_DXF
+	TYPE_DXF,
+	TYPE_SVG
 };
 
 class ImportNode : public LeafNode
@@ -28,4 +29,7 @@ public:
 	double fn, fs, fa;
 	double origin_x, origin_y, scale;
 	virtual class Geometry *createGeometry() const;
+
+private:
+	class Geometry *readGeometry() const;
 };
@@ -24,6 +24,7 @@
  *
  */
 #include "GeometryCache.h"
+#include "ImportCache.h"
 #include "ModuleCache.h"
 #include "MainWindow.h"
 #include "parsersettings.h"
@@ -48,6 +49,7 @@
 #include "LibraryInfoDialog.h"
 #ifdef ENABLE_OPENCSG
 #include "CSGTermEvaluator.h"
+#include "CSGTermCache.h"
 #include "OpenCSGRenderer.h"
 #include <opencsg.h>
 #endif
@@ -336,6 +338,7 @@ MainWindow::MainWindow(const QString &filename)
 	connect(this->designActionExportSTL, SIGNAL(triggered()), this, SLOT(actionExportSTL()));
 	connect(this->designActionExportOFF, SIGNAL(triggered()), this, SLOT(actionExportOFF()));
 	connect(this->designActionExportAMF, SIGNAL(triggered()), this, SLOT(actionExportAMF()));
+	connect(this->designActionExport3MF, SIGNAL(triggered()), this, SLOT(actionExport3MF()));
 	connect(this->designActionExportDXF, SIGNAL(triggered()), this, SLOT(actionExportDXF()));
 	connect(this->designActionExportSVG, SIGNAL(triggered()), this, SLOT(actionExportSVG()));
 	connect(this->designActionExportCSG, SIGNAL(triggered()), this, SLOT(actionExportCSG()));
@@ -510,6 +513,10 @@ void MainWindow::loadDesignSettings()
 	}
 	uint polySetCacheSize = Preferences::inst()->getValue("advanced/polysetCacheSize").toUInt();
 	GeometryCache::instance()->setMaxSize(polySetCacheSize);
+	uint importCacheSize = Preferences::inst()->getValue("advanced/importCacheSize").toUInt();
+	ImportCache::instance()->setMaxSize(importCacheSize);
+	uint fontCacheSize = Preferences::inst()->getValue("advanced/fontCacheSize").toUInt();
+	FontCache::set_max_size(fontCacheSize);
 #ifdef ENABLE_CGAL
 	uint cgalCacheSize = Preferences::inst()->getValue("advanced/cgalCacheSize").toUInt();
 	CGALCache::instance()->setMaxSize(cgalCacheSize);
@@ -915,6 +922,7 @@ void MainWindow::compileCSG(bool procevents)
 			PRINT("ERROR: CSG generation failed! (no top level object found)");
 		}
 		GeometryCache::instance()->print();
+		ImportCache::instance()->print();
 #ifdef ENABLE_CGAL
 		CGALCache::instance()->print();
 #endif
@@ -1586,6 +1594,7 @@ void MainWindow::actionRenderDone(shared_ptr<const Geometry> root_geom)
 
 	if (root_geom) {
 		GeometryCache::instance()->print();
+		ImportCache::instance()->print();
 #ifdef ENABLE_CGAL
 		CGALCache::instance()->print();
 #endif
@@ -1770,11 +1779,12 @@ void MainWindow::actionExport(export_type_e, QString, QString)
 	case EXPORT_TYPE_STL: format = OPENSCAD_STL; break;
 	case EXPORT_TYPE_OFF: format = OPENSCAD_OFF; break;
 	case EXPORT_TYPE_AMF: format = OPENSCAD_AMF; break;
+	case EXPORT_TYPE_3MF: format = OPENSCAD_3MF; break;
 	default:
 		assert(false && "Unknown export type");
 		break;
 	}
-	exportFileByName(this->root_geom.get(), format, export_filename.toUtf8(),
+	exportFileByName(this->tree, this->root_geom.get(), format, export_filename.toUtf8(),
 		export_filename.toLocal8Bit().constData());
 	PRINTB("%s export finished.", type_name);
 
@@ -1797,6 +1807,11 @@ void MainWindow::actionExportAMF()
 	actionExport(EXPORT_TYPE_AMF, "AMF", ".amf");
 }
 
+void MainWindow::actionExport3MF()
+{
+	actionExport(EXPORT_TYPE_3MF, "3MF", ".3mf");
+}
+
 QString MainWindow::get2dExportFilename(QString format, QString extension) {
 	setCurrentOutput();
 
@@ -1906,6 +1921,8 @@ void MainWindow::actionExportImage()
 void MainWindow::actionFlushCaches()
 {
 	GeometryCache::instance()->clear();
+	CSGTermCache::instance()->clear();
+	ImportCache::instance()->clear();
 #ifdef ENABLE_CGAL
 	CGALCache::instance()->clear();
 #endif
@@ -77,6 +77,14 @@
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 namespace Render { enum type { GEOMETRY, CGAL, OPENCSG, THROWNTOGETHER }; };
+
+// A camera to export a PNG image from, named for the output file
+struct CameraView {
+	CameraView(const Camera &camera, const std::string &name = "") : camera(camera), name(name) {}
+	Camera camera;
+	std::string name;
+};
+typedef std::vector<CameraView> CameraViews;
 std::string commandline_commands;
 std::string currentdir;
 using std::string;
@@ -96,6 +104,7 @@ public:
 		*thisp << msg << "\n";
 	}
 	~Echostream() {
+		set_output_handler(NULL, NULL);
 		this->close();
 	}
 };
@@ -107,15 +116,17 @@ static void help(const char *progname)
   for (int i=0;i<tablen;i++) tabstr[i] = ' ';
   tabstr[tablen] = '\0';
 
-	PRINTB("Usage: %1% [ -o output_file [ -d deps_file ] ]\\\n"
+	PRINTB("Usage: %1% [ -o output_file [ -d deps_file ] | --batch=job_file ]\\\n"
          "%2%[ -m make_command ] [ -D var=val [..] ] \\\n"
          "%2%[ --version ] [ --info ] \\\n"
          "%2%[ --camera=translatex,y,z,rotx,y,z,dist | \\\n"
-         "%2%  --camera=eyex,y,z,centerx,y,z ] \\\n"
+         "%2%  --camera=eyex,y,z,centerx,y,z | \\\n"
+         "%2%  --camera=camera;camera[;..] | --camera=camera_file ] \\\n"
          "%2%[ --autocenter ] \\\n"
          "%2%[ --viewall ] \\\n"
          "%2%[ --imgsize=width,height ] [ --projection=(o)rtho|(p)ersp] \\\n"
          "%2%[ --render | --preview[=throwntogether] ] \\\n"
+         "%2%[ --render-backend=opengl|soft ] \\\n"
          "%2%[ --colorscheme=[Cornfield|Sunset|Metallic|Starnight|BeforeDawn|Nature|DeepOcean] ] \\\n"
          "%2%[ --csglimit=num ]"
 #ifdef ENABLE_EXPERIMENTAL
@@ -155,14 +166,14 @@ static void info()
 	exit(0);
 }
 
-Camera get_camera(po::variables_map vm)
+Camera get_camera(po::variables_map vm, const std::string &spec)
 {
 	Camera camera;
 
-	if (vm.count("camera")) {
+	if (!spec.empty()) {
 		vector<string> strs;
 		vector<double> cam_parameters;
-		split(strs, vm["camera"].as<string>(), is_any_of(","));
+		split(strs, spec, is_any_of(","));
 		if ( strs.size()==6 || strs.size()==7 ) {
 			try {
 				BOOST_FOREACH(string &s, strs) cam_parameters.push_back(lexical_cast<double>(s));
@@ -226,6 +237,67 @@ Camera get_camera(po::variables_map vm)
 	return camera;
 }
 
+/*!
+	Returns the views to export PNG images from. --camera takes either a
+	single camera, several cameras separated by ';', or the name of a camera
+	file. A camera file holds one camera per line, optionally preceded by a
+	name which is used for the output file, e.g.
+	  top 0,0,0,0,0,0,140
+	Empty lines and lines starting with '#' are ignored.
+*/
+static CameraViews get_views(po::variables_map vm)
+{
+	CameraViews views;
+	if (!vm.count("camera")) {
+		views.push_back(CameraView(get_camera(vm, "")));
+		return views;
+	}
+
+	string arg = vm["camera"].as<string>();
+	if (arg.find(',') == string::npos && fs::is_regular_file(arg)) {
+		std::ifstream ifs(arg.c_str());
+		string line;
+		while (std::getline(ifs, line)) {
+			boost::trim(line);
+			if (line.empty() || line[0] == '#') continue;
+			vector<string> strs;
+			split(strs, line, is_any_of(" \t"), boost::token_compress_on);
+			if (strs.size() > 2) {
+				PRINTB("Invalid line in camera file '%s': %s", arg % line);
+				exit(1);
+			}
+			views.push_back(CameraView(get_camera(vm, strs.back()), strs.size() == 2 ? strs[0] : ""));
+		}
+		if (views.empty()) {
+			PRINTB("No cameras in camera file '%s'", arg);
+			exit(1);
+		}
+	}
+	else {
+		vector<string> specs;
+		split(specs, arg, is_any_of(";"));
+		BOOST_FOREACH(string &spec, specs) {
+			boost::trim(spec);
+			if (!spec.empty()) views.push_back(CameraView(get_camera(vm, spec)));
+		}
+	}
+	return views;
+}
+
+/*!
+	With several views, each one is written to output_file with the view
+	name (or its 1-based index) appended to the base name,
+	e.g. part.png -> part_top.png.
+*/
+static std::string view_output_file(const char *output_file, const CameraViews &views, size_t i)
+{
+	if (views.size() == 1) return output_file;
+	std::string out(output_file);
+	std::string suffix = boosty::extension_str(out);
+	std::string name = views[i].name.empty() ? lexical_cast<string>(i + 1) : views[i].name;
+	return out.substr(0, out.size() - suffix.size()) + "_" + name + suffix;
+}
+
 #ifdef OPENSCAD_TESTING
 #undef OPENSCAD_QTGUI
 #else
@@ -233,7 +305,7 @@ Camera get_camera(po::variables_map vm)
 #include <QApplication>
 #include <QSettings>
 #endif
-static bool checkAndExport(shared_ptr<const Geometry> root_geom, unsigned nd,
+static bool checkAndExport(Tree &tree, shared_ptr<const Geometry> root_geom, unsigned nd,
 	enum FileFormat format, const char *filename)
 {
 	if (root_geom->getDimension() != nd) {
@@ -244,20 +316,18 @@ static bool checkAndExport(shared_ptr<const Geometry> root_geom, unsigned nd,
 		PRINT("Current top level object is empty.");
 		return false;
 	}
-	exportFileByName(root_geom.get(), format, filename, filename);
+	exportFileByName(tree, root_geom.get(), format, filename, filename);
 	return true;
 }
 
-int cmdline(const char *deps_output_file, const std::string &filename, Camera &camera, const char *output_file, const fs::path &original_path, Render::type renderer, int argc, char ** argv )
+/*!
+	Evaluates the given file once and writes output_file.
+	job_commands are appended to the main file only, after the global -D
+	commands, so they don't invalidate cached libraries.
+*/
+static int cmdline_job(const char *deps_output_file, const std::string &filename, const std::string &job_commands, const CameraViews &views, const char *output_file, const fs::path &original_path, Render::type renderer)
 {
-#ifdef OPENSCAD_QTGUI
-	QCoreApplication app(argc, argv);
-	const std::string application_path = QApplication::instance()->applicationDirPath().toLocal8Bit().constData();
-#else
-	const std::string application_path = boosty::stringy(boosty::absolute(boost::filesystem::path(argv[0]).parent_path()));
-#endif	
-	PlatformUtils::registerApplicationPath(application_path);
-	parser_init(PlatformUtils::applicationPath());
+	fs::current_path(original_path);
 	Tree tree;
 #ifdef ENABLE_CGAL
 	GeometryEvaluator geomevaluator(tree);
@@ -265,6 +335,7 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 	const char *stl_output_file = NULL;
 	const char *off_output_file = NULL;
 	const char *amf_output_file = NULL;
+	const char *threemf_output_file = NULL;
 	const char *dxf_output_file = NULL;
 	const char *svg_output_file = NULL;
 	const char *csg_output_file = NULL;
@@ -279,6 +350,7 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 	if (suffix == ".stl") stl_output_file = output_file;
 	else if (suffix == ".off") off_output_file = output_file;
 	else if (suffix == ".amf") amf_output_file = output_file;
+	else if (suffix == ".3mf") threemf_output_file = output_file;
 	else if (suffix == ".dxf") dxf_output_file = output_file;
 	else if (suffix == ".svg") svg_output_file = output_file;
 	else if (suffix == ".csg") csg_output_file = output_file;
@@ -315,7 +387,7 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 		return 1;
 	}
 	std::string text((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-	text += "\n" + commandline_commands;
+	text += "\n" + commandline_commands + job_commands;
 	fs::path abspath = boosty::absolute(filename);
 	std::string parentpath = boosty::stringy(abspath.parent_path());
 	root_module = parse(text.c_str(), parentpath.c_str(), false);
@@ -412,6 +484,7 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 			if ( stl_output_file ) geom_out = std::string(stl_output_file);
 			else if ( off_output_file ) geom_out = std::string(off_output_file);
 			else if ( amf_output_file ) geom_out = std::string(amf_output_file);
+			else if ( threemf_output_file ) geom_out = std::string(threemf_output_file);
 			else if ( dxf_output_file ) geom_out = std::string(dxf_output_file);
 			else if ( svg_output_file ) geom_out = std::string(svg_output_file);
 			else if ( png_output_file ) geom_out = std::string(png_output_file);
@@ -428,44 +501,60 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 		}
 
 		if (stl_output_file) {
-			if (!checkAndExport(root_geom, 3, OPENSCAD_STL, stl_output_file))
+			if (!checkAndExport(tree, root_geom, 3, OPENSCAD_STL, stl_output_file))
 				return 1;
 		}
 
 		if (off_output_file) {
-			if (!checkAndExport(root_geom, 3, OPENSCAD_OFF, off_output_file))
+			if (!checkAndExport(tree, root_geom, 3, OPENSCAD_OFF, off_output_file))
 				return 1;
 		}
 
 		if (amf_output_file) {
-			if (!checkAndExport(root_geom, 3, OPENSCAD_AMF, amf_output_file))
+			if (!checkAndExport(tree, root_geom, 3, OPENSCAD_AMF, amf_output_file))
+				return 1;
+		}
+
+		if (threemf_output_file) {
+			if (!checkAndExport(tree, root_geom, 3, OPENSCAD_3MF, threemf_output_file))
 				return 1;
 		}
 
 		if (dxf_output_file) {
-			if (!checkAndExport(root_geom, 2, OPENSCAD_DXF, dxf_output_file))
+			if (!checkAndExport(tree, root_geom, 2, OPENSCAD_DXF, dxf_output_file))
 				return 1;
 		}
 		
 		if (svg_output_file) {
-			if (!checkAndExport(root_geom, 2, OPENSCAD_SVG, svg_output_file))
+			if (!checkAndExport(tree, root_geom, 2, OPENSCAD_SVG, svg_output_file))
 				return 1;
 		}
 
 		if (png_output_file) {
-			std::ofstream fstream(png_output_file,std::ios::out|std::ios::binary);
-			if (!fstream.is_open()) {
-				PRINTB("Can't open file \"%s\" for export", png_output_file);
+			// All views share the evaluated geometry or CSG chains
+			std::vector<Camera> cameras;
+			std::vector<shared_ptr<std::ofstream> > fstreams;
+			std::vector<std::ostream *> outputs;
+			for (size_t i = 0; i < views.size(); i++) {
+				std::string view_file = view_output_file(png_output_file, views, i);
+				shared_ptr<std::ofstream> fstream(new std::ofstream(view_file.c_str(), std::ios::out|std::ios::binary));
+				if (!fstream->is_open()) {
+					PRINTB("Can't open file \"%s\" for export", view_file);
+					continue;
+				}
+				cameras.push_back(views[i].camera);
+				fstreams.push_back(fstream);
+				outputs.push_back(fstream.get());
 			}
-			else {
+			if (!cameras.empty()) {
 				if (renderer==Render::CGAL || renderer==Render::GEOMETRY) {
-					export_png(root_geom, camera, fstream);
+					export_png(root_geom, cameras, outputs);
 				} else if (renderer==Render::THROWNTOGETHER) {
-					export_png_with_throwntogether(tree, camera, fstream);
+					export_png_with_throwntogether(tree, cameras, outputs);
 				} else {
-					export_png_with_opencsg(tree, camera, fstream);
+					export_png_with_opencsg(tree, cameras, outputs);
 				}
-				fstream.close();
+				BOOST_FOREACH(shared_ptr<std::ofstream> &fstream, fstreams) fstream->close();
 			}
 		}
 #else
@@ -473,10 +562,73 @@ int cmdline(const char *deps_output_file, const std::string &filename, Camera &c
 		return 1;
 #endif
 	}
-	delete root_node;
+	delete absolute_root_node;
+	delete root_module;
 	return 0;
 }
 
+/*!
+	Runs all jobs of the given job file in sequence, in one process, so
+	libraries (ModuleCache) and geometry (GeometryCache, CGALCache) stay
+	cached between jobs.
+
+	Each line of the job file describes one job: the output file, optionally
+	followed by variable assignments, e.g.
+	  part_1.stl part=1; color="red";
+	Empty lines and lines starting with '#' are ignored.
+*/
+static int cmdline_batch(const std::string &batch_file, const std::string &filename, const CameraViews &views, const fs::path &original_path, Render::type renderer)
+{
+	std::ifstream ifs(batch_file.c_str());
+	if (!ifs.is_open()) {
+		PRINTB("Can't open batch file '%s'!\n", batch_file);
+		return 1;
+	}
+
+	int failed = 0, jobs = 0;
+	std::string line;
+	while (std::getline(ifs, line)) {
+		boost::trim(line);
+		if (line.empty() || line[0] == '#') continue;
+
+		std::string::size_type split = line.find_first_of(" \t");
+		std::string job_output = line.substr(0, split);
+		std::string job_commands;
+		if (split != std::string::npos) {
+			job_commands = boost::trim_copy(line.substr(split));
+			if (!job_commands.empty() && job_commands[job_commands.size()-1] != ';') job_commands += ";";
+			job_commands += "\n";
+		}
+
+		jobs++;
+		PRINTB("Batch job %d: %s", jobs % job_output);
+		if (cmdline_job(NULL, filename, job_commands, views, job_output.c_str(), original_path, renderer) != 0) {
+			PRINTB("Batch job %d failed: %s", jobs % job_output);
+			failed++;
+		}
+	}
+	fs::current_path(original_path);
+	PRINTB("Batch done: %d jobs, %d failed", jobs % failed);
+	return failed ? 1 : 0;
+}
+
+int cmdline(const char *deps_output_file, const std::string &filename, const CameraViews &views, const char *output_file, const std::string &batch_file, const fs::path &original_path, Render::type renderer, int argc, char ** argv )
+{
+#ifdef OPENSCAD_QTGUI
+	QCoreApplication app(argc, argv);
+	const std::string application_path = QApplication::instance()->applicationDirPath().toLocal8Bit().constData();
+#else
+	const std::string application_path = boosty::stringy(boosty::absolute(boost::filesystem::path(argv[0]).parent_path()));
+#endif	
+	PlatformUtils::registerApplicationPath(application_path);
+	parser_init(PlatformUtils::applicationPath());
+
+	if (!batch_file.empty()) {
+		return cmdline_batch(batch_file, filename, views, original_path, renderer);
+	}
+	return cmdline_job(deps_output_file, filename, "", views, output_file, original_path, renderer);
+}
+
 #ifdef OPENSCAD_QTGUI
 #include <QtPlugin>
 #if defined(__MINGW64__) || defined(__MINGW32__) || defined(_MSCVER)
@@ -644,7 +796,8 @@ int main(int argc, char **argv)
 		("render", po::value<string>()->implicit_value(""), "if exporting a png image, do a full geometry evaluation")
 		("preview", po::value<string>()->implicit_value(""), "if exporting a png image, do an OpenCSG(default) or ThrownTogether preview")
 		("csglimit", po::value<unsigned int>(), "if exporting a png image, stop rendering at the given number of CSG elements")
-		("camera", po::value<string>(), "parameters for camera when exporting png")
+		("render-backend", po::value<string>(), "opengl or soft (software rasterizer, needs no OpenGL context) for exporting png")
+		("camera", po::value<string>(), "parameters for camera when exporting png; several cameras separated by ';' or a camera file export one png per view")
 		("autocenter", "adjust camera to look at object center")
 		("viewall", "adjust camera to fit object")
 		("imgsize", po::value<string>(), "=width,height for exporting png")
@@ -652,6 +805,7 @@ int main(int argc, char **argv)
 		("colorscheme", po::value<string>(), "colorscheme")
 		("debug", po::value<string>(), "special debug info")
 		("o,o", po::value<string>(), "out-file")
+		("batch", po::value<string>(), "job file with one output file and variable assignments per line")
 		("s,s", po::value<string>(), "stl-file")
 		("x,x", po::value<string>(), "dxf-file")
 		("d,d", po::value<string>(), "deps-file")
@@ -700,6 +854,18 @@ int main(int argc, char **argv)
 		else renderer = Render::GEOMETRY;
 	}
 
+	if (vm.count("render-backend")) {
+		string backend = vm["render-backend"].as<string>();
+		if (backend == "soft") RenderSettings::inst()->backend = RenderSettings::SOFTWARE;
+		else if (backend == "opengl") RenderSettings::inst()->backend = RenderSettings::OPENGL;
+		else help(argv[0]);
+	}
+	if (RenderSettings::inst()->backend == RenderSettings::SOFTWARE &&
+			(renderer == Render::OPENCSG || renderer == Render::THROWNTOGETHER)) {
+		// The software rasterizer draws evaluated geometry only
+		renderer = Render::GEOMETRY;
+	}
+
 	if (vm.count("csglimit")) {
 		RenderSettings::inst()->openCSGTermLimit = vm["csglimit"].as<unsigned int>();
 	}
@@ -768,20 +934,26 @@ int main(int argc, char **argv)
 
 	currentdir = boosty::stringy(fs::current_path());
 
-	Camera camera = get_camera(vm);
+	CameraViews views = get_views(vm);
 
 	// Initialize global visitors
 	NodeCache nodecache;
 	NodeDumper dumper(nodecache);
 
+	std::string batch_file;
+	if (vm.count("batch")) {
+		if (output_file || deps_output_file) help(argv[0]);
+		batch_file = vm["batch"].as<string>();
+	}
+
 	bool cmdlinemode = false;
-	if (output_file) { // cmd-line mode
+	if (output_file || !batch_file.empty()) { // cmd-line mode
 		cmdlinemode = true;
 		if (!inputFiles.size()) help(argv[0]);
 	}
 
 	if (cmdlinemode) {
-		rc = cmdline(deps_output_file, inputFiles[0], camera, output_file, original_path, renderer, argc, argv);
+		rc = cmdline(deps_output_file, inputFiles[0], views, output_file, batch_file, original_path, renderer, argc, argv);
 	}
 	else if (QtUseGUI()) {
 		rc = gui(inputFiles, original_path, argc, argv);
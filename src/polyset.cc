@@ -81,6 +81,7 @@ std::string PolySet::dump() const
 
 void PolySet::append_poly()
 {
+	clear_render_arrays();
 	polygons.push_back(Polygon());
 }
 
@@ -91,6 +92,7 @@ void PolySet::append_vertex(double x, double y, double z)
 
 void PolySet::append_vertex(Vector3d v)
 {
+	clear_render_arrays();
 	polygons.back().push_back(v);
 }
 
@@ -101,6 +103,7 @@ void PolySet::insert_vertex(double x, double y, double z)
 
 void PolySet::insert_vertex(Vector3d v)
 {
+	clear_render_arrays();
 	polygons.back().insert(polygons.back().begin(), v);
 }
 
@@ -128,11 +131,13 @@ size_t PolySet::memsize() const
 
 void PolySet::append(const PolySet &ps)
 {
+	clear_render_arrays();
 	this->polygons.insert(this->polygons.end(), ps.polygons.begin(), ps.polygons.end());
 }
 
 void PolySet::transform(const Transform3d &mat)
 {
+	clear_render_arrays();
 	BOOST_FOREACH(Polygon &p, this->polygons) {
 		BOOST_FOREACH(Vector3d &v, p) {
 			v = mat * v;
@@ -185,7 +190,23 @@ void PolySet::resize(Vector3d newsize, const Eigen::Matrix<bool,3,1> &autosize)
 
 // all GL functions grouped together here
 #ifndef NULLGL
-static void gl_draw_triangle(GLint *shaderinfo, const Vector3d &p0, const Vector3d &p1, const Vector3d &p2, bool e0, bool e1, bool e2, double z, bool mirrored)
+// Floats per vertex in a surface array: position and normal, plus the
+// four OpenCSG edge shader attributes if used
+static const size_t SURFACE_STRIDE = 6;
+static const size_t SURFACE_SHADER_STRIDE = 18;
+
+static void add_vector(std::vector<float> &data, double x, double y, double z)
+{
+	data.push_back(x);
+	data.push_back(y);
+	data.push_back(z);
+}
+
+/*!
+	Appends one triangle to an interleaved surface array, emitting the
+	vertices in the same order as the former immediate mode rendering.
+*/
+static void add_triangle(std::vector<float> &data, bool shader, const Vector3d &p0, const Vector3d &p1, const Vector3d &p2, bool e0, bool e1, bool e2, double z, bool mirrored)
 {
 	double ax = p1[0] - p0[0], bx = p1[0] - p2[0];
 	double ay = p1[1] - p0[1], by = p1[1] - p2[1];
@@ -194,82 +215,64 @@ static void gl_draw_triangle(GLint *shaderinfo, const Vector3d &p0, const Vector
 	double ny = az*bx - ax*bz;
 	double nz = ax*by - ay*bx;
 	double nl = sqrt(nx*nx + ny*ny + nz*nz);
-	glNormal3d(nx / nl, ny / nl, nz / nl);
-#ifdef ENABLE_OPENCSG
-	if (shaderinfo) {
-		double e0f = e0 ? 2.0 : -1.0;
-		double e1f = e1 ? 2.0 : -1.0;
-		double e2f = e2 ? 2.0 : -1.0;
-		glVertexAttrib3d(shaderinfo[3], e0f, e1f, e2f);
-		glVertexAttrib3d(shaderinfo[4], p1[0], p1[1], p1[2] + z);
-		glVertexAttrib3d(shaderinfo[5], p2[0], p2[1], p2[2] + z);
-		glVertexAttrib3d(shaderinfo[6], 0.0, 1.0, 0.0);
-		glVertex3d(p0[0], p0[1], p0[2] + z);
-		if (!mirrored) {
-			glVertexAttrib3d(shaderinfo[3], e0f, e1f, e2f);
-			glVertexAttrib3d(shaderinfo[4], p0[0], p0[1], p0[2] + z);
-			glVertexAttrib3d(shaderinfo[5], p2[0], p2[1], p2[2] + z);
-			glVertexAttrib3d(shaderinfo[6], 0.0, 0.0, 1.0);
-			glVertex3d(p1[0], p1[1], p1[2] + z);
-		}
-		glVertexAttrib3d(shaderinfo[3], e0f, e1f, e2f);
-		glVertexAttrib3d(shaderinfo[4], p0[0], p0[1], p0[2] + z);
-		glVertexAttrib3d(shaderinfo[5], p1[0], p1[1], p1[2] + z);
-		glVertexAttrib3d(shaderinfo[6], 1.0, 0.0, 0.0);
-		glVertex3d(p2[0], p2[1], p2[2] + z);
-		if (mirrored) {
-			glVertexAttrib3d(shaderinfo[3], e0f, e1f, e2f);
-			glVertexAttrib3d(shaderinfo[4], p0[0], p0[1], p0[2] + z);
-			glVertexAttrib3d(shaderinfo[5], p2[0], p2[1], p2[2] + z);
-			glVertexAttrib3d(shaderinfo[6], 0.0, 0.0, 1.0);
-			glVertex3d(p1[0], p1[1], p1[2] + z);
+
+	double e0f = e0 ? 2.0 : -1.0;
+	double e1f = e1 ? 2.0 : -1.0;
+	double e2f = e2 ? 2.0 : -1.0;
+
+	// For each vertex: the two other vertices and the barycentric mask
+	const Vector3d *points[3][3] = {{&p0, &p1, &p2}, {&p1, &p0, &p2}, {&p2, &p0, &p1}};
+	const double masks[3][3] = {{0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}, {1.0, 0.0, 0.0}};
+	const int order[2][3] = {{0, 1, 2}, {0, 2, 1}};
+
+	for (int i = 0; i < 3; i++) {
+		int k = order[mirrored][i];
+		const Vector3d &p = *points[k][0];
+		add_vector(data, p[0], p[1], p[2] + z);
+		add_vector(data, nx / nl, ny / nl, nz / nl);
+		if (shader) {
+			const Vector3d &pb = *points[k][1];
+			const Vector3d &pc = *points[k][2];
+			add_vector(data, e0f, e1f, e2f);
+			add_vector(data, pb[0], pb[1], pb[2] + z);
+			add_vector(data, pc[0], pc[1], pc[2] + z);
+			add_vector(data, masks[k][0], masks[k][1], masks[k][2]);
 		}
 	}
-	else
-#endif
-	{
-		glVertex3d(p0[0], p0[1], p0[2] + z);
-		if (!mirrored)
-			glVertex3d(p1[0], p1[1], p1[2] + z);
-		glVertex3d(p2[0], p2[1], p2[2] + z);
-		if (mirrored)
-			glVertex3d(p1[0], p1[1], p1[2] + z);
-	}
 }
 
-void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m, GLint *shaderinfo) const
+const std::vector<float> &PolySet::surface_array(double zbase, bool mirrored, bool shader) const
 {
-	PRINTD("Polyset render");
-	bool mirrored = m.matrix().determinant() < 0;
-#ifdef ENABLE_OPENCSG
-	if (shaderinfo) {
-		glUniform1f(shaderinfo[7], shaderinfo[9]);
-		glUniform1f(shaderinfo[8], shaderinfo[10]);
+	BOOST_FOREACH(const SurfaceArray &a, this->surface_arrays) {
+		if (a.zbase == zbase && a.mirrored == mirrored && a.shader == shader) return a.data;
 	}
-#endif /* ENABLE_OPENCSG */
-	if (this->dim == 2) {
-		// Render 2D objects 1mm thick, but differences slightly larger
-		double zbase = 1 + (csgmode & CSGMODE_DIFFERENCE_FLAG) * 0.1;
-		glBegin(GL_TRIANGLES);
 
+	this->surface_arrays.push_back(SurfaceArray());
+	SurfaceArray &array = this->surface_arrays.back();
+	array.zbase = zbase;
+	array.mirrored = mirrored;
+	array.shader = shader;
+	std::vector<float> &data = array.data;
+
+	if (this->dim == 2) {
 		// Render top+bottom
 		for (double z = -zbase/2; z < zbase; z += zbase) {
 			for (size_t i = 0; i < polygons.size(); i++) {
 				const Polygon *poly = &polygons[i];
 				if (poly->size() == 3) {
 					if (z < 0) {
-						gl_draw_triangle(shaderinfo, poly->at(0), poly->at(2), poly->at(1), true, true, true, z, mirrored);
+						add_triangle(data, shader, poly->at(0), poly->at(2), poly->at(1), true, true, true, z, mirrored);
 					} else {
-						gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(2), true, true, true, z, mirrored);
+						add_triangle(data, shader, poly->at(0), poly->at(1), poly->at(2), true, true, true, z, mirrored);
 					}
 				}
 				else if (poly->size() == 4) {
 					if (z < 0) {
-						gl_draw_triangle(shaderinfo, poly->at(0), poly->at(3), poly->at(1), true, false, true, z, mirrored);
-						gl_draw_triangle(shaderinfo, poly->at(2), poly->at(1), poly->at(3), true, false, true, z, mirrored);
+						add_triangle(data, shader, poly->at(0), poly->at(3), poly->at(1), true, false, true, z, mirrored);
+						add_triangle(data, shader, poly->at(2), poly->at(1), poly->at(3), true, false, true, z, mirrored);
 					} else {
-						gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(3), true, false, true, z, mirrored);
-						gl_draw_triangle(shaderinfo, poly->at(2), poly->at(3), poly->at(1), true, false, true, z, mirrored);
+						add_triangle(data, shader, poly->at(0), poly->at(1), poly->at(3), true, false, true, z, mirrored);
+						add_triangle(data, shader, poly->at(2), poly->at(3), poly->at(1), true, false, true, z, mirrored);
 					}
 				}
 				else {
@@ -282,11 +285,11 @@ void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m,
 					center[1] /= poly->size();
 					for (size_t j = 1; j <= poly->size(); j++) {
 						if (z < 0) {
-							gl_draw_triangle(shaderinfo, center, poly->at(j % poly->size()), poly->at(j - 1),
-									false, true, false, z, mirrored);
+							add_triangle(data, shader, center, poly->at(j % poly->size()), poly->at(j - 1),
+													 false, true, false, z, mirrored);
 						} else {
-							gl_draw_triangle(shaderinfo, center, poly->at(j - 1), poly->at(j % poly->size()),
-									false, true, false, z, mirrored);
+							add_triangle(data, shader, center, poly->at(j - 1), poly->at(j % poly->size()),
+													 false, true, false, z, mirrored);
 						}
 					}
 				}
@@ -301,8 +304,8 @@ void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m,
 					Vector3d p2(o.vertices[j-1][0], o.vertices[j-1][1], zbase/2);
 					Vector3d p3(o.vertices[j % o.vertices.size()][0], o.vertices[j % o.vertices.size()][1], -zbase/2);
 					Vector3d p4(o.vertices[j % o.vertices.size()][0], o.vertices[j % o.vertices.size()][1], zbase/2);
-					gl_draw_triangle(shaderinfo, p2, p1, p3, true, true, false, 0, mirrored);
-					gl_draw_triangle(shaderinfo, p2, p3, p4, false, true, true, 0, mirrored);
+					add_triangle(data, shader, p2, p1, p3, true, true, false, 0, mirrored);
+					add_triangle(data, shader, p2, p3, p4, false, true, true, 0, mirrored);
 				}
 			}
 		}
@@ -317,22 +320,27 @@ void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m,
 					Vector3d p3 = poly->at(j % poly->size()), p4 = poly->at(j % poly->size());
 					p1[2] -= zbase/2, p2[2] += zbase/2;
 					p3[2] -= zbase/2, p4[2] += zbase/2;
-					gl_draw_triangle(shaderinfo, p2, p1, p3, true, true, false, 0, mirrored);
-					gl_draw_triangle(shaderinfo, p2, p3, p4, false, true, true, 0, mirrored);
+					add_triangle(data, shader, p2, p1, p3, true, true, false, 0, mirrored);
+					add_triangle(data, shader, p2, p3, p4, false, true, true, 0, mirrored);
 				}
 			}
 		}
-		glEnd();
 	} else if (this->dim == 3) {
+		size_t numtriangles = 0;
+		for (size_t i = 0; i < polygons.size(); i++) {
+			size_t n = polygons[i].size();
+			numtriangles += n == 3 ? 1 : n == 4 ? 2 : n;
+		}
+		data.reserve(numtriangles * 3 * (shader ? SURFACE_SHADER_STRIDE : SURFACE_STRIDE));
+
 		for (size_t i = 0; i < polygons.size(); i++) {
 			const Polygon *poly = &polygons[i];
-			glBegin(GL_TRIANGLES);
 			if (poly->size() == 3) {
-				gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(2), true, true, true, 0, mirrored);
+				add_triangle(data, shader, poly->at(0), poly->at(1), poly->at(2), true, true, true, 0, mirrored);
 			}
 			else if (poly->size() == 4) {
-				gl_draw_triangle(shaderinfo, poly->at(0), poly->at(1), poly->at(3), true, false, true, 0, mirrored);
-				gl_draw_triangle(shaderinfo, poly->at(2), poly->at(3), poly->at(1), true, false, true, 0, mirrored);
+				add_triangle(data, shader, poly->at(0), poly->at(1), poly->at(3), true, false, true, 0, mirrored);
+				add_triangle(data, shader, poly->at(2), poly->at(3), poly->at(1), true, false, true, 0, mirrored);
 			}
 			else {
 				Vector3d center = Vector3d::Zero();
@@ -345,15 +353,58 @@ void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m,
 				center[1] /= poly->size();
 				center[2] /= poly->size();
 				for (size_t j = 1; j <= poly->size(); j++) {
-					gl_draw_triangle(shaderinfo, center, poly->at(j - 1), poly->at(j % poly->size()), false, true, false, 0, mirrored);
+					add_triangle(data, shader, center, poly->at(j - 1), poly->at(j % poly->size()), false, true, false, 0, mirrored);
 				}
 			}
-			glEnd();
 		}
 	}
 	else {
 		assert(false && "Cannot render object with no dimension");
 	}
+	return data;
+}
+
+void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m, GLint *shaderinfo) const
+{
+	PRINTD("Polyset render");
+	bool mirrored = m.matrix().determinant() < 0;
+	bool shader = false;
+#ifdef ENABLE_OPENCSG
+	if (shaderinfo) {
+		glUniform1f(shaderinfo[7], shaderinfo[9]);
+		glUniform1f(shaderinfo[8], shaderinfo[10]);
+		shader = true;
+	}
+#endif /* ENABLE_OPENCSG */
+	// Render 2D objects 1mm thick, but differences slightly larger
+	double zbase = this->dim == 2 ? 1 + (csgmode & CSGMODE_DIFFERENCE_FLAG) * 0.1 : 0;
+
+	const std::vector<float> &data = surface_array(zbase, mirrored, shader);
+	if (data.empty()) return;
+	size_t stride = shader ? SURFACE_SHADER_STRIDE : SURFACE_STRIDE;
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, stride * sizeof(float), &data[0]);
+	glNormalPointer(GL_FLOAT, stride * sizeof(float), &data[3]);
+#ifdef ENABLE_OPENCSG
+	if (shader) {
+		for (int i = 0; i < 4; i++) {
+			glEnableVertexAttribArray(shaderinfo[3 + i]);
+			glVertexAttribPointer(shaderinfo[3 + i], 3, GL_FLOAT, GL_FALSE, stride * sizeof(float), &data[6 + 3*i]);
+		}
+	}
+#endif /* ENABLE_OPENCSG */
+
+	glDrawArrays(GL_TRIANGLES, 0, data.size() / stride);
+
+#ifdef ENABLE_OPENCSG
+	if (shader) {
+		for (int i = 0; i < 4; i++) glDisableVertexAttribArray(shaderinfo[3 + i]);
+	}
+#endif /* ENABLE_OPENCSG */
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
 }
 
 /*! This is used in throwntogether and CGAL mode
@@ -399,14 +450,23 @@ void PolySet::render_edges(Renderer::csgmode_e csgmode) const
 			}
 		}
 	} else if (dim == 3) {
-		for (size_t i = 0; i < polygons.size(); i++) {
-			const Polygon *poly = &polygons[i];
-			glBegin(GL_LINE_LOOP);
-			for (size_t j = 0; j < poly->size(); j++) {
-				const Vector3d &p = poly->at(j);
-				glVertex3d(p[0], p[1], p[2]);
+		if (this->edge_array.empty()) {
+			// One line segment per polygon edge
+			for (size_t i = 0; i < polygons.size(); i++) {
+				const Polygon *poly = &polygons[i];
+				for (size_t j = 0; j < poly->size(); j++) {
+					const Vector3d &p = poly->at(j);
+					const Vector3d &q = poly->at((j + 1) % poly->size());
+					add_vector(this->edge_array, p[0], p[1], p[2]);
+					add_vector(this->edge_array, q[0], q[1], q[2]);
+				}
 			}
-			glEnd();
+		}
+		if (!this->edge_array.empty()) {
+			glEnableClientState(GL_VERTEX_ARRAY);
+			glVertexPointer(3, GL_FLOAT, 0, &this->edge_array[0]);
+			glDrawArrays(GL_LINES, 0, this->edge_array.size() / 3);
+			glDisableClientState(GL_VERTEX_ARRAY);
 		}
 	}
 	else {
@@ -416,7 +476,6 @@ void PolySet::render_edges(Renderer::csgmode_e csgmode) const
 }
 
 #else //NULLGL
-static void gl_draw_triangle(GLint *shaderinfo, const Vector3d &p0, const Vector3d &p1, const Vector3d &p2, bool e0, bool e1, bool e2, double z, bool mirrored) {}
 void PolySet::render_surface(Renderer::csgmode_e csgmode, const Transform3d &m, GLint *shaderinfo) const {}
 void PolySet::render_edges(Renderer::csgmode_e csgmode) const {}
 #endif //NULLGL
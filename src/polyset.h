@@ -48,4 +48,21 @@ private:
 	Polygon2d polygon;
 	unsigned int dim;
 	mutable boost::tribool convex;
+
+	/*!
+		Interleaved vertex arrays for render_surface() and render_edges(). They
+		are built on first use and drawn with glDrawArrays() afterwards. Any
+		modification through the member functions drops them.
+	*/
+	struct SurfaceArray {
+		double zbase;
+		bool mirrored;
+		bool shader;
+		std::vector<float> data;
+	};
+	mutable std::vector<SurfaceArray> surface_arrays;
+	mutable std::vector<float> edge_array;
+
+	const std::vector<float> &surface_array(double zbase, bool mirrored, bool shader) const;
+	void clear_render_arrays() { surface_arrays.clear(); edge_array.clear(); }
 };
@@ -282,19 +282,28 @@ AbstractNode *PrimitiveModule::instantiate(const Context *ctx, const ModuleInsta
 	return node;
 }
 
-struct point2d {
-	double x, y;
-};
-
-static void generate_circle(point2d *circle, double r, int fragments)
+static void generate_circle(std::vector<Vector2d> &circle, double r, int fragments)
 {
+	circle.resize(fragments);
 	for (int i=0; i<fragments; i++) {
 		double phi = (M_PI*2*i) / fragments;
-		circle[i].x = r*cos(phi);
-		circle[i].y = r*sin(phi);
+		circle[i] = Vector2d(r*cos(phi), r*sin(phi));
 	}
 }
 
+// Appends a new polygon to ps and returns it with room for the given number of vertices
+static PolySet::Polygon &add_polygon(PolySet &ps, size_t numvertices)
+{
+	ps.polygons.push_back(PolySet::Polygon());
+	ps.polygons.back().reserve(numvertices);
+	return ps.polygons.back();
+}
+
+static Vector3d point3d(const Vector2d &p, double z)
+{
+	return Vector3d(p[0], p[1], z);
+}
+
 /*!
 	Creates geometry for this node.
 	May return an empty Geometry creation failed, but will not return NULL.
@@ -367,7 +376,7 @@ Geometry *PrimitiveNode::createGeometry() const
 		g = p;
 		if (this->r1 > 0 && !isinf(this->r1)) {
 			struct ring_s {
-				point2d *points;
+				std::vector<Vector2d> points;
 				double z;
 			};
 
@@ -376,7 +385,7 @@ Geometry *PrimitiveNode::createGeometry() const
 // Uncomment the following three lines to enable experimental sphere tesselation
 //		if (rings % 2 == 0) rings++; // To ensure that the middle ring is at phi == 0 degrees
 
-			ring_s *ring = new ring_s[rings];
+			std::vector<ring_s> ring(rings);
 
 //		double offset = 0.5 * ((fragments / 2) % 2);
 			for (int i = 0; i < rings; i++) {
@@ -384,56 +393,39 @@ Geometry *PrimitiveNode::createGeometry() const
 				double phi = (M_PI * (i + 0.5)) / rings;
 				double r = r1 * sin(phi);
 				ring[i].z = r1 * cos(phi);
-				ring[i].points = new point2d[fragments];
 				generate_circle(ring[i].points, r, fragments);
 			}
 
-			p->append_poly();
+			// Two caps plus two triangles per fragment between each pair of rings
+			p->polygons.reserve(2 + size_t(rings-1) * fragments * 2);
+
+			PolySet::Polygon &top = add_polygon(*p, fragments);
 			for (int i = 0; i < fragments; i++)
-				p->append_vertex(ring[0].points[i].x, ring[0].points[i].y, ring[0].z);
+				top.push_back(point3d(ring[0].points[i], ring[0].z));
 
+			// All rings have the same number of fragments, so the triangles
+			// between two rings alternate between pointing down and up.
 			for (int i = 0; i < rings-1; i++) {
-				ring_s *r1 = &ring[i];
-				ring_s *r2 = &ring[i+1];
-				int r1i = 0, r2i = 0;
-				while (r1i < fragments || r2i < fragments)
-				{
-					if (r1i >= fragments)
-						goto sphere_next_r2;
-					if (r2i >= fragments)
-						goto sphere_next_r1;
-					if ((double)r1i / fragments <
-							(double)r2i / fragments)
-					{
-					sphere_next_r1:
-						p->append_poly();
-						int r1j = (r1i+1) % fragments;
-						p->insert_vertex(r1->points[r1i].x, r1->points[r1i].y, r1->z);
-						p->insert_vertex(r1->points[r1j].x, r1->points[r1j].y, r1->z);
-						p->insert_vertex(r2->points[r2i % fragments].x, r2->points[r2i % fragments].y, r2->z);
-						r1i++;
-					} else {
-					sphere_next_r2:
-						p->append_poly();
-						int r2j = (r2i+1) % fragments;
-						p->append_vertex(r2->points[r2i].x, r2->points[r2i].y, r2->z);
-						p->append_vertex(r2->points[r2j].x, r2->points[r2j].y, r2->z);
-						p->append_vertex(r1->points[r1i % fragments].x, r1->points[r1i % fragments].y, r1->z);
-						r2i++;
-					}
+				const ring_s &r1 = ring[i];
+				const ring_s &r2 = ring[i+1];
+				for (int j = 0; j < fragments; j++) {
+					int k = (j+1) % fragments;
+					PolySet::Polygon &down = add_polygon(*p, 3);
+					down.push_back(point3d(r2.points[j], r2.z));
+					down.push_back(point3d(r2.points[k], r2.z));
+					down.push_back(point3d(r1.points[j], r1.z));
+
+					PolySet::Polygon &up = add_polygon(*p, 3);
+					up.push_back(point3d(r2.points[k], r2.z));
+					up.push_back(point3d(r1.points[k], r1.z));
+					up.push_back(point3d(r1.points[j], r1.z));
 				}
 			}
 
-			p->append_poly();
-			for (int i = 0; i < fragments; i++)
-				p->insert_vertex(ring[rings-1].points[i].x, 
-												 ring[rings-1].points[i].y, 
-												 ring[rings-1].z);
-
-			for (int i = 0; i < rings; i++) {
-				delete[] ring[i].points;
-			}
-			delete[] ring;
+			const ring_s &last = ring[rings-1];
+			PolySet::Polygon &bottom = add_polygon(*p, fragments);
+			for (int i = fragments-1; i >= 0; i--)
+				bottom.push_back(point3d(last.points[i], last.z));
 		}
 	}
 		break;
@@ -454,50 +446,46 @@ Geometry *PrimitiveNode::createGeometry() const
 				z2 = this->h;
 			}
 
-			point2d *circle1 = new point2d[fragments];
-			point2d *circle2 = new point2d[fragments];
-
+			std::vector<Vector2d> circle1, circle2;
 			generate_circle(circle1, r1, fragments);
 			generate_circle(circle2, r2, fragments);
-		
+
+			p->polygons.reserve(2 + size_t(fragments) * 2);
 			for (int i=0; i<fragments; i++) {
 				int j = (i+1) % fragments;
 				if (r1 == r2) {
-					p->append_poly();
-					p->insert_vertex(circle1[i].x, circle1[i].y, z1);
-					p->insert_vertex(circle2[i].x, circle2[i].y, z2);
-					p->insert_vertex(circle2[j].x, circle2[j].y, z2);
-					p->insert_vertex(circle1[j].x, circle1[j].y, z1);
+					PolySet::Polygon &quad = add_polygon(*p, 4);
+					quad.push_back(point3d(circle1[j], z1));
+					quad.push_back(point3d(circle2[j], z2));
+					quad.push_back(point3d(circle2[i], z2));
+					quad.push_back(point3d(circle1[i], z1));
 				} else {
 					if (r1 > 0) {
-						p->append_poly();
-						p->insert_vertex(circle1[i].x, circle1[i].y, z1);
-						p->insert_vertex(circle2[i].x, circle2[i].y, z2);
-						p->insert_vertex(circle1[j].x, circle1[j].y, z1);
+						PolySet::Polygon &tri = add_polygon(*p, 3);
+						tri.push_back(point3d(circle1[j], z1));
+						tri.push_back(point3d(circle2[i], z2));
+						tri.push_back(point3d(circle1[i], z1));
 					}
 					if (r2 > 0) {
-						p->append_poly();
-						p->insert_vertex(circle2[i].x, circle2[i].y, z2);
-						p->insert_vertex(circle2[j].x, circle2[j].y, z2);
-						p->insert_vertex(circle1[j].x, circle1[j].y, z1);
+						PolySet::Polygon &tri = add_polygon(*p, 3);
+						tri.push_back(point3d(circle1[j], z1));
+						tri.push_back(point3d(circle2[j], z2));
+						tri.push_back(point3d(circle2[i], z2));
 					}
 				}
 			}
 
 			if (this->r1 > 0) {
-				p->append_poly();
-				for (int i=0; i<fragments; i++)
-					p->insert_vertex(circle1[i].x, circle1[i].y, z1);
+				PolySet::Polygon &bottom = add_polygon(*p, fragments);
+				for (int i=fragments-1; i>=0; i--)
+					bottom.push_back(point3d(circle1[i], z1));
 			}
 
 			if (this->r2 > 0) {
-				p->append_poly();
+				PolySet::Polygon &top = add_polygon(*p, fragments);
 				for (int i=0; i<fragments; i++)
-					p->append_vertex(circle2[i].x, circle2[i].y, z2);
+					top.push_back(point3d(circle2[i], z2));
 			}
-
-			delete[] circle1;
-			delete[] circle2;
 		}
 	}
 		break;
@@ -555,11 +543,7 @@ Geometry *PrimitiveNode::createGeometry() const
 			int fragments = Calc::get_fragments_from_r(this->r1, this->fn, this->fs, this->fa);
 
 			Outline2d o;
-			o.vertices.resize(fragments);
-			for (int i=0; i < fragments; i++) {
-				double phi = (M_PI*2*i) / fragments;
-				o.vertices[i] = Vector2d(this->r1*cos(phi), this->r1*sin(phi));
-			}
+			generate_circle(o.vertices, this->r1, fragments);
 			p->addOutline(o);
 			p->setSanitized(true);
 		}
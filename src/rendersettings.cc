@@ -19,4 +19,9 @@ RenderSettings::RenderSettings()
 	img_width = 512;
 	img_height = 512;
 	colorscheme = "Cornfield";
+#ifdef NULLGL
+	backend = SOFTWARE;
+#else
+	backend = OPENGL;
+#endif
 }
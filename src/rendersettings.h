@@ -9,9 +9,13 @@ class RenderSettings
 public:
 	static RenderSettings *inst(bool erase = false);
 
+	// How PNG images are produced: through an OpenGL context or SoftwareRasterizer
+	enum Backend { OPENGL, SOFTWARE };
+
 	unsigned int openCSGTermLimit, img_width, img_height;
 	double far_gl_clip_limit;
 	std::string colorscheme;
+	Backend backend;
 private:
 	RenderSettings();
 	~RenderSettings() {}
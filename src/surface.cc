@@ -37,9 +37,11 @@
 
 #include <sstream>
 #include <fstream>
+#include <limits>
 #include <boost/foreach.hpp>
-#include <boost/unordered_map.hpp>
 #include <boost/tokenizer.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/assign/std/vector.hpp>
@@ -55,7 +57,50 @@ public:
 	virtual AbstractNode *instantiate(const Context *ctx, const ModuleInstantiation *inst, const EvalContext *evalctx) const;
 };
 
-typedef boost::unordered_map<std::pair<int,int>,double> img_data_t;
+/*!
+	Dense, row-major height field. Rows and columns are addressed as
+	(row, column), matching the layout of the DAT file format.
+	min_val is the lowest height of any explicitly given sample, minus one,
+	and is used as the floor of the generated solid.
+*/
+class img_data_t
+{
+public:
+	typedef float storage_type;
+
+	img_data_t() : rows(0), columns(0), min_val(std::numeric_limits<double>::max()) { }
+
+	void resize(int rows, int columns) {
+		// Grow in place; samples which were never set read as zero
+		if (columns != this->columns) {
+			std::vector<storage_type> newdata(size_t(rows) * columns, 0);
+			for (int i = 0; i < std::min(rows, this->rows); i++) {
+				std::copy(data.begin() + size_t(i) * this->columns,
+									data.begin() + size_t(i) * this->columns + std::min(columns, this->columns),
+									newdata.begin() + size_t(i) * columns);
+			}
+			data.swap(newdata);
+		}
+		else {
+			data.resize(size_t(rows) * columns, 0);
+		}
+		this->rows = rows;
+		this->columns = columns;
+	}
+	void set(int row, int col, double v) {
+		data[size_t(row) * columns + col] = v;
+		min_val = std::min(v - 1, min_val);
+	}
+	double operator()(int row, int col) const { return data[size_t(row) * columns + col]; }
+	bool empty() const { return data.empty(); }
+
+	int rows;
+	int columns;
+	double min_val;
+
+private:
+	std::vector<storage_type> data;
+};
 
 class SurfaceNode : public LeafNode
 {
@@ -76,8 +121,8 @@ public:
 private:
 	void convert_image(img_data_t &data, std::vector<unsigned char> &img, unsigned int width, unsigned int height) const;
 	bool is_png(std::vector<unsigned char> &img) const;
-	img_data_t read_dat(std::string filename) const;
-	img_data_t read_png_or_dat(std::string filename) const;
+	void read_dat(img_data_t &data, std::string filename) const;
+	void read_png_or_dat(img_data_t &data, std::string filename) const;
 };
 
 AbstractNode *SurfaceModule::instantiate(const Context *ctx, const ModuleInstantiation *inst, const EvalContext *evalctx) const
@@ -131,6 +176,8 @@ void SurfaceNode::convert_image(img_data_t &data, std::vector<unsigned char> &im
 
 	double h = 100;
 	double scale = h / (z_max - z_min);
+	// Row 0 is left empty (all zeroes) for compatibility with earlier versions
+	data.resize(height + 1, width);
 	for (unsigned int y = 0;y < height;y++) {
 		for (unsigned int x = 0;x < width;x++) {
 			long idx = 4 * (y * width + x);
@@ -139,8 +186,7 @@ void SurfaceNode::convert_image(img_data_t &data, std::vector<unsigned char> &im
 			if (invert) {
 				z = h - z;
 			}
-			data[std::make_pair(height - y, x)] = z;
-			
+			data.set(height - y, x, z);
 		}
 	}
 }
@@ -158,16 +204,16 @@ bool SurfaceNode::is_png(std::vector<unsigned char> &png) const
 		&& (png[7] == 0x0a);
 }
 
-img_data_t SurfaceNode::read_png_or_dat(std::string filename) const
+void SurfaceNode::read_png_or_dat(img_data_t &data, std::string filename) const
 {
-	img_data_t data;
 	std::vector<unsigned char> png;
 	
 	lodepng::load_file(png, filename);
 	
 	if (!is_png(png)) {
 		png.clear();
-		return read_dat(filename);
+		read_dat(data, filename);
+		return;
 	}
 	
 	unsigned int width, height;
@@ -175,27 +221,23 @@ img_data_t SurfaceNode::read_png_or_dat(std::string filename) const
 	unsigned error = lodepng::decode(img, width, height, png);
 	if (error) {
 		PRINTB("ERROR: Can't read PNG image '%s'", filename);
-		data.clear();
-		return data;
+		return;
 	}
 	
 	convert_image(data, img, width, height);
-	
-	return data;
 }
 
-img_data_t SurfaceNode::read_dat(std::string filename) const
+void SurfaceNode::read_dat(img_data_t &data, std::string filename) const
 {
-	img_data_t data;
 	std::ifstream stream(filename.c_str());
 
 	if (!stream.good()) {
 		PRINTB("WARNING: Can't open DAT file '%s'.", filename);
-		return data;
+		return;
 	}
 
 	int lines = 0, columns = 0;
-	double min_val = 0;
+	std::vector<double> row;
 
 	typedef boost::tokenizer<boost::char_separator<char> > tokenizer;
 	boost::char_separator<char> sep(" \t");
@@ -208,89 +250,115 @@ img_data_t SurfaceNode::read_dat(std::string filename) const
 		}
 		if (line.size() == 0 && stream.eof()) break;
 
-		int col = 0;
+		row.clear();
 		tokenizer tokens(line, sep);
+		bool failed = false;
 		try {
 			BOOST_FOREACH(const std::string &token, tokens) {
-				double v = boost::lexical_cast<double>(token);
-				data[std::make_pair(lines, col++)] = v;
-				if (col > columns) columns = col;
-				min_val = std::min(v-1, min_val);
+				row.push_back(boost::lexical_cast<double>(token));
 			}
 		}
 		catch (const boost::bad_lexical_cast &blc) {
 			if (!stream.eof()) {
 				PRINTB("WARNING: Illegal value in '%s': %s", filename % blc.what());
 			}
-			break;
-  	}
+			failed = true;
+		}
+
+		// Values preceding an illegal one are kept, but reading stops there
+		if (!row.empty()) {
+			columns = std::max(columns, int(row.size()));
+			data.resize(lines + 1, columns);
+			for (size_t col = 0; col < row.size(); col++) data.set(lines, col, row[col]);
+		}
+		if (failed) break;
 		lines++;
 	}
-	
-	return data;
+}
+
+/*!
+	Writes the four top triangles of each grid cell of the given rows
+	directly into their preallocated slots in polygons.
+*/
+static void fill_surface_rows(PolySet::Polygon *polygons, const img_data_t &data,
+															int first_row, int last_row, double ox, double oy)
+{
+	const int columns = data.columns;
+	PolySet::Polygon *p = polygons + size_t(first_row - 1) * (columns - 1) * 4;
+	for (int i = first_row; i < last_row; i++)
+	for (int j = 1; j < columns; j++)
+	{
+		double v1 = data(i-1, j-1);
+		double v2 = data(i-1, j);
+		double v3 = data(i, j-1);
+		double v4 = data(i, j);
+		double vx = (v1 + v2 + v3 + v4) / 4;
+
+		Vector3d c1(ox + j-1, oy + i-1, v1);
+		Vector3d c2(ox + j, oy + i-1, v2);
+		Vector3d c3(ox + j-1, oy + i, v3);
+		Vector3d c4(ox + j, oy + i, v4);
+		Vector3d cx(ox + j-0.5, oy + i-0.5, vx);
+
+		p->reserve(3); p->push_back(c1); p->push_back(c2); p->push_back(cx); p++;
+		p->reserve(3); p->push_back(c2); p->push_back(c4); p->push_back(cx); p++;
+		p->reserve(3); p->push_back(c4); p->push_back(c3); p->push_back(cx); p++;
+		p->reserve(3); p->push_back(c3); p->push_back(c1); p->push_back(cx); p++;
+	}
 }
 
 Geometry *SurfaceNode::createGeometry() const
 {
-	img_data_t data = read_png_or_dat(filename);
+	img_data_t data;
+	read_png_or_dat(data, filename);
 
 	PolySet *p = new PolySet(3);
 	p->setConvexity(convexity);
 	
-	int lines = 0;
-	int columns = 0;
-	double min_val = std::numeric_limits<double>::max();
-	for (img_data_t::iterator it = data.begin();it != data.end();it++) {
-		lines = std::max(lines, (*it).first.first + 1);
-		columns = std::max(columns, (*it).first.second + 1);
-		min_val = std::min((*it).second - 1, min_val);
-	}
+	int lines = data.rows;
+	int columns = data.columns;
+	double min_val = data.min_val;
 
 	double ox = center ? -(columns-1)/2.0 : 0;
 	double oy = center ? -(lines-1)/2.0 : 0;
 
-	for (int i = 1; i < lines; i++)
-	for (int j = 1; j < columns; j++)
-	{
-		double v1 = data[std::make_pair(i-1, j-1)];
-		double v2 = data[std::make_pair(i-1, j)];
-		double v3 = data[std::make_pair(i, j-1)];
-		double v4 = data[std::make_pair(i, j)];
-		double vx = (v1 + v2 + v3 + v4) / 4;
-
-		p->append_poly();
-		p->append_vertex(ox + j-1, oy + i-1, v1);
-		p->append_vertex(ox + j, oy + i-1, v2);
-		p->append_vertex(ox + j-0.5, oy + i-0.5, vx);
-
-		p->append_poly();
-		p->append_vertex(ox + j, oy + i-1, v2);
-		p->append_vertex(ox + j, oy + i, v4);
-		p->append_vertex(ox + j-0.5, oy + i-0.5, vx);
-
-		p->append_poly();
-		p->append_vertex(ox + j, oy + i, v4);
-		p->append_vertex(ox + j-1, oy + i, v3);
-		p->append_vertex(ox + j-0.5, oy + i-0.5, vx);
-
-		p->append_poly();
-		p->append_vertex(ox + j-1, oy + i, v3);
-		p->append_vertex(ox + j-1, oy + i-1, v1);
-		p->append_vertex(ox + j-0.5, oy + i-0.5, vx);
+	if (lines > 1 && columns > 1) {
+		// Top surface: 4 triangles per cell, plus 2 quads per side cell and the bottom
+		size_t cells = size_t(lines-1) * (columns-1);
+		p->polygons.reserve(cells * 4 + 2 * (lines-1) + 2 * (columns-1) + 1);
+		p->polygons.resize(cells * 4);
+
+		// Rows are independent, so large height fields are split across threads
+		unsigned int nthreads = std::max(1u, boost::thread::hardware_concurrency());
+		if (cells < 65536) nthreads = 1;
+		nthreads = std::min(nthreads, (unsigned int)(lines-1));
+		if (nthreads == 1) {
+			fill_surface_rows(&p->polygons[0], data, 1, lines, ox, oy);
+		}
+		else {
+			boost::thread_group threads;
+			for (unsigned int t = 0; t < nthreads; t++) {
+				int first = 1 + int((size_t(lines-1) * t) / nthreads);
+				int last = 1 + int((size_t(lines-1) * (t+1)) / nthreads);
+				threads.create_thread(boost::bind(fill_surface_rows, &p->polygons[0], boost::cref(data),
+																					first, last, ox, oy));
+			}
+			threads.join_all();
+		}
 	}
 
 	for (int i = 1; i < lines; i++)
 	{
 		p->append_poly();
 		p->append_vertex(ox + 0, oy + i-1, min_val);
-		p->append_vertex(ox + 0, oy + i-1, data[std::make_pair(i-1, 0)]);
-		p->append_vertex(ox + 0, oy + i, data[std::make_pair(i, 0)]);
+		p->append_vertex(ox + 0, oy + i-1, data(i-1, 0));
+		p->append_vertex(ox + 0, oy + i, data(i, 0));
 		p->append_vertex(ox + 0, oy + i, min_val);
 
 		p->append_poly();
 		p->insert_vertex(ox + columns-1, oy + i-1, min_val);
-		p->insert_vertex(ox + columns-1, oy + i-1, data[std::make_pair(i-1, columns-1)]);
-		p->insert_vertex(ox + columns-1, oy + i, data[std::make_pair(i, columns-1)]);
+		p->insert_vertex(ox + columns-1, oy + i-1, data(i-1, columns-1));
+		p->insert_vertex(ox + columns-1, oy + i, data(i, columns-1));
 		p->insert_vertex(ox + columns-1, oy + i, min_val);
 	}
 
@@ -298,14 +366,14 @@ Geometry *SurfaceNode::createGeometry() const
 	{
 		p->append_poly();
 		p->insert_vertex(ox + i-1, oy + 0, min_val);
-		p->insert_vertex(ox + i-1, oy + 0, data[std::make_pair(0, i-1)]);
-		p->insert_vertex(ox + i, oy + 0, data[std::make_pair(0, i)]);
+		p->insert_vertex(ox + i-1, oy + 0, data(0, i-1));
+		p->insert_vertex(ox + i, oy + 0, data(0, i));
 		p->insert_vertex(ox + i, oy + 0, min_val);
 
 		p->append_poly();
 		p->append_vertex(ox + i-1, oy + lines-1, min_val);
-		p->append_vertex(ox + i-1, oy + lines-1, data[std::make_pair(lines-1, i-1)]);
-		p->append_vertex(ox + i, oy + lines-1, data[std::make_pair(lines-1, i)]);
+		p->append_vertex(ox + i-1, oy + lines-1, data(lines-1, i-1));
+		p->append_vertex(ox + i, oy + lines-1, data(lines-1, i));
 		p->append_vertex(ox + i, oy + lines-1, min_val);
 	}
 
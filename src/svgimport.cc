@@ -0,0 +1,690 @@
+/*
+ *  OpenSCAD (www.openscad.org)
+ *  Copyright (C) 2009-2011 Clifford Wolf <clifford@clifford.at> and
+ *                          Marius Kintel <marius@kintel.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  As a special exception, you have permission to link this program
+ *  with the CGAL library and distribute executables, as long as you
+ *  follow the requirements of the GNU GPL in regard to all of the
+ *  software in the executable aside from CGAL.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "svgimport.h"
+#include "Polygon2d.h"
+#include "clipper-utils.h"
+#include "calc.h"
+#include "grid.h"
+#include "printutils.h"
+#include "handle_dep.h"
+#include "mathc99.h"
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <stdlib.h>
+#include <ctype.h>
+#include <boost/unordered_map.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string.hpp>
+
+/*! \file svgimport.cc
+
+	A minimal SVG reader for 2D import. Supported are the basic shapes
+	(rect, circle, ellipse, polygon, polyline) and path, including the
+	transform and fill-rule attributes. Curves and arcs are flattened using
+	$fn, $fs and $fa. Text, stroke widths, clipping, <use> and CSS
+	stylesheets are ignored.
+
+	The Y axis is flipped so that the drawing appears upright, with the
+	bottom edge of the viewBox (or height) on the X axis. One SVG user unit
+	becomes one OpenSCAD unit before origin and scale are applied.
+ */
+
+namespace {
+
+	typedef std::vector<Vector2d> SvgContour;
+
+	struct SvgShape {
+		std::vector<SvgContour> contours;
+		bool evenodd;
+		SvgShape() : evenodd(false) {}
+	};
+
+	struct SvgState {
+		Transform2d transform;
+		bool evenodd;
+		bool hidden;
+	};
+	typedef std::vector<SvgState, Eigen::aligned_allocator<SvgState> > SvgStateStack;
+
+	typedef boost::unordered_map<std::string, std::string> SvgAttributes;
+
+	double svg_length(const SvgAttributes &attribs, const char *name, double defaultval = 0)
+	{
+		SvgAttributes::const_iterator it = attribs.find(name);
+		if (it == attribs.end()) return defaultval;
+		const char *start = it->second.c_str();
+		char *end;
+		double v = strtod(start, &end);
+		return (end == start) ? defaultval : v;
+	}
+
+	std::string svg_attribute(const SvgAttributes &attribs, const char *name)
+	{
+		SvgAttributes::const_iterator it = attribs.find(name);
+		return (it == attribs.end()) ? std::string() : it->second;
+	}
+
+	/*!
+		Reads the numbers of a path, points or transform attribute.
+		Handles SVG's compact notation, e.g. "1.5.5-2" == "1.5 .5 -2".
+	*/
+	class NumberReader {
+	public:
+		NumberReader(const std::string &s) : text(s), p(text.c_str()) {}
+
+		void skip() { while (*p && (isspace(*p) || *p == ',')) p++; }
+		bool atEnd() { skip(); return *p == '\0'; }
+		char peek() { skip(); return *p; }
+		char get() { skip(); return *p ? *p++ : '\0'; }
+		bool number(double &v) {
+			skip();
+			if (!(isdigit(*p) || *p == '-' || *p == '+' || *p == '.')) return false;
+			char *end;
+			v = strtod(p, &end);
+			if (end == p) return false;
+			p = end;
+			return true;
+		}
+		bool flag(bool &f) {
+			skip();
+			if (*p != '0' && *p != '1') return false;
+			f = (*p++ == '1');
+			return true;
+		}
+
+	private:
+		std::string text;
+		const char *p;
+	};
+
+	/*!
+		Flattens curves into line segments using the $fn, $fs and $fa
+		semantics of circles, applied proportionally to partial turns.
+	*/
+	class SvgFlattener {
+	public:
+		SvgFlattener(double fn, double fs, double fa) : fn(fn), fs(fs), fa(fa), unitscale(1) {}
+
+		/*!
+			Number of segments for a curve turning by angle degrees over the
+			given length (in user units).
+		*/
+		int segments(double length, double angle) const {
+			length *= unitscale;
+			if (length < GRID_FINE) return 1;
+			if (fn > 0.0) return std::max(1, (int)ceil((fn >= 3 ? fn : 3) * angle / 360));
+			return std::max(1, (int)ceil(fmin(angle / fa, length / fs)));
+		}
+
+		void cubic(SvgContour &c, const Vector2d &p0, const Vector2d &p1,
+							 const Vector2d &p2, const Vector2d &p3) const {
+			int n = segments(control_length(p0, p1, p2, p3), control_turn(p0, p1, p2, p3));
+			for (int i = 1; i < n; i++) {
+				double t = double(i) / n, u = 1 - t;
+				c.push_back(u*u*u*p0 + 3*u*u*t*p1 + 3*u*t*t*p2 + t*t*t*p3);
+			}
+			c.push_back(p3);
+		}
+
+		void quadratic(SvgContour &c, const Vector2d &p0, const Vector2d &p1, const Vector2d &p2) const {
+			int n = segments(control_length(p0, p1, p1, p2), control_turn(p0, p1, p1, p2));
+			for (int i = 1; i < n; i++) {
+				double t = double(i) / n, u = 1 - t;
+				c.push_back(u*u*p0 + 2*u*t*p1 + t*t*p2);
+			}
+			c.push_back(p2);
+		}
+
+		/*!
+			Elliptical arc in SVG endpoint parameterization, see
+			http://www.w3.org/TR/SVG/implnote.html#ArcImplementationNotes
+		*/
+		void arc(SvgContour &c, Vector2d p0, double rx, double ry, double phi,
+						 bool large, bool sweep, const Vector2d &p1) const {
+			if (p0 == p1) return;
+			rx = fabs(rx);
+			ry = fabs(ry);
+			if (rx < GRID_FINE || ry < GRID_FINE) {
+				c.push_back(p1);
+				return;
+			}
+			double cosphi = cos(phi * M_PI / 180), sinphi = sin(phi * M_PI / 180);
+			Vector2d d = (p0 - p1) / 2;
+			double x1 = cosphi * d[0] + sinphi * d[1];
+			double y1 = -sinphi * d[0] + cosphi * d[1];
+			double lambda = (x1*x1) / (rx*rx) + (y1*y1) / (ry*ry);
+			if (lambda > 1) {
+				rx *= sqrt(lambda);
+				ry *= sqrt(lambda);
+			}
+			double num = rx*rx*ry*ry - rx*rx*y1*y1 - ry*ry*x1*x1;
+			double den = rx*rx*y1*y1 + ry*ry*x1*x1;
+			double coef = (den > 0 && num > 0) ? sqrt(num / den) : 0;
+			if (large == sweep) coef = -coef;
+			double cx1 = coef * rx * y1 / ry;
+			double cy1 = -coef * ry * x1 / rx;
+			Vector2d mid = (p0 + p1) / 2;
+			Vector2d center(cosphi * cx1 - sinphi * cy1 + mid[0], sinphi * cx1 + cosphi * cy1 + mid[1]);
+
+			double theta1 = atan2((y1 - cy1) / ry, (x1 - cx1) / rx);
+			double dtheta = atan2((-y1 - cy1) / ry, (-x1 - cx1) / rx) - theta1;
+			if (!sweep && dtheta > 0) dtheta -= 2 * M_PI;
+			else if (sweep && dtheta < 0) dtheta += 2 * M_PI;
+
+			int n = segments(std::max(rx, ry) * fabs(dtheta), fabs(dtheta) * 180 / M_PI);
+			for (int i = 1; i < n; i++) {
+				double t = theta1 + dtheta * i / n;
+				c.push_back(Vector2d(cosphi * rx * cos(t) - sinphi * ry * sin(t) + center[0],
+														 sinphi * rx * cos(t) + cosphi * ry * sin(t) + center[1]));
+			}
+			c.push_back(p1);
+		}
+
+		void ellipse(SvgContour &c, double cx, double cy, double rx, double ry) const {
+			int n = Calc::get_fragments_from_r(std::max(rx, ry) * unitscale, fn, fs, fa);
+			for (int i = 0; i < n; i++) {
+				double phi = (2 * M_PI * i) / n;
+				c.push_back(Vector2d(cx + rx * cos(phi), cy + ry * sin(phi)));
+			}
+		}
+
+		double fn, fs, fa;
+		// Approximate scale from user units to output units
+		double unitscale;
+
+	private:
+		static double control_length(const Vector2d &p0, const Vector2d &p1,
+																 const Vector2d &p2, const Vector2d &p3) {
+			return (p1 - p0).norm() + (p2 - p1).norm() + (p3 - p2).norm();
+		}
+		// Total turning of the control polygon in degrees
+		static double control_turn(const Vector2d &p0, const Vector2d &p1,
+															 const Vector2d &p2, const Vector2d &p3) {
+			Vector2d legs[3] = { p1 - p0, p2 - p1, p3 - p2 };
+			double turn = 0;
+			Vector2d prev(0, 0);
+			for (int i = 0; i < 3; i++) {
+				if (legs[i].norm() < GRID_FINE) continue;
+				if (prev.norm() > 0) {
+					turn += fabs(atan2(prev[0] * legs[i][1] - prev[1] * legs[i][0], prev.dot(legs[i])));
+				}
+				prev = legs[i];
+			}
+			return turn * 180 / M_PI;
+		}
+	};
+
+	Transform2d svg_transform(const std::string &value)
+	{
+		Transform2d result(Transform2d::Identity());
+		std::string::size_type pos = 0;
+		while (pos < value.size()) {
+			std::string::size_type open = value.find('(', pos);
+			std::string::size_type close = value.find(')', open);
+			if (open == std::string::npos || close == std::string::npos) break;
+			std::string name = boost::trim_copy_if(value.substr(pos, open - pos), boost::is_any_of(" \t\r\n,"));
+			NumberReader reader(value.substr(open + 1, close - open - 1));
+			std::vector<double> args;
+			double v;
+			while (reader.number(v)) args.push_back(v);
+			pos = close + 1;
+
+			Transform2d t(Transform2d::Identity());
+			if (name == "matrix" && args.size() == 6) {
+				t.matrix() <<
+					args[0], args[2], args[4],
+					args[1], args[3], args[5],
+					0, 0, 1;
+			}
+			else if (name == "translate" && args.size() >= 1) {
+				t.translate(Vector2d(args[0], args.size() > 1 ? args[1] : 0));
+			}
+			else if (name == "scale" && args.size() >= 1) {
+				t.scale(Vector2d(args[0], args.size() > 1 ? args[1] : args[0]));
+			}
+			else if (name == "rotate" && args.size() >= 1) {
+				Vector2d c = (args.size() >= 3) ? Vector2d(args[1], args[2]) : Vector2d(0, 0);
+				t.translate(c);
+				t.rotate(args[0] * M_PI / 180);
+				t.translate(-c);
+			}
+			else if (name == "skewX" && args.size() == 1) {
+				t.matrix()(0, 1) = tan(args[0] * M_PI / 180);
+			}
+			else if (name == "skewY" && args.size() == 1) {
+				t.matrix()(1, 0) = tan(args[0] * M_PI / 180);
+			}
+			else {
+				PRINTB("WARNING: Ignoring unsupported SVG transform '%s'", name);
+				continue;
+			}
+			result = result * t;
+		}
+		return result;
+	}
+
+	bool svg_points(SvgShape &shape, const std::string &value)
+	{
+		NumberReader reader(value);
+		SvgContour contour;
+		double x, y;
+		while (reader.number(x) && reader.number(y)) contour.push_back(Vector2d(x, y));
+		if (contour.size() < 3) return false;
+		shape.contours.push_back(contour);
+		return true;
+	}
+
+	bool svg_path(SvgShape &shape, const std::string &d, const SvgFlattener &flattener)
+	{
+		NumberReader reader(d);
+		Vector2d cur(0, 0), start(0, 0), ctrl(0, 0);
+		char cmd = '\0', prevcmd = '\0';
+		SvgContour *contour = NULL;
+
+		while (!reader.atEnd()) {
+			char c = reader.peek();
+			if (isalpha(c)) {
+				cmd = reader.get();
+			}
+			else if (cmd == '\0' || cmd == 'Z' || cmd == 'z') {
+				PRINTB("WARNING: Malformed SVG path data near '%c'", c);
+				break;
+			}
+			bool rel = islower(cmd);
+			Vector2d base = rel ? cur : Vector2d(0, 0);
+
+			if (cmd != 'M' && cmd != 'm' && cmd != 'Z' && cmd != 'z' && !contour) {
+				// Drawing after closepath starts a new subpath at the current point
+				shape.contours.push_back(SvgContour(1, cur));
+				contour = &shape.contours.back();
+			}
+
+			double v[7];
+			bool flags[2];
+			bool ok = true;
+			switch (toupper(cmd)) {
+			case 'M':
+				if ((ok = reader.number(v[0]) && reader.number(v[1]))) {
+					cur = start = base + Vector2d(v[0], v[1]);
+					shape.contours.push_back(SvgContour(1, cur));
+					contour = &shape.contours.back();
+					// Subsequent coordinate pairs are implicit lineto commands
+					cmd = rel ? 'l' : 'L';
+				}
+				break;
+			case 'L':
+				if ((ok = reader.number(v[0]) && reader.number(v[1]))) {
+					cur = base + Vector2d(v[0], v[1]);
+					contour->push_back(cur);
+				}
+				break;
+			case 'H':
+				if ((ok = reader.number(v[0]))) {
+					cur[0] = base[0] + v[0];
+					contour->push_back(cur);
+				}
+				break;
+			case 'V':
+				if ((ok = reader.number(v[0]))) {
+					cur[1] = base[1] + v[0];
+					contour->push_back(cur);
+				}
+				break;
+			case 'C':
+			case 'S': {
+				Vector2d c1;
+				if (toupper(cmd) == 'C') {
+					ok = reader.number(v[0]) && reader.number(v[1]);
+					c1 = base + Vector2d(v[0], v[1]);
+				}
+				else {
+					bool smooth = (toupper(prevcmd) == 'C' || toupper(prevcmd) == 'S');
+					c1 = smooth ? Vector2d(2 * cur - ctrl) : cur;
+				}
+				if ((ok = ok && reader.number(v[2]) && reader.number(v[3]) &&
+						 reader.number(v[4]) && reader.number(v[5]))) {
+					ctrl = base + Vector2d(v[2], v[3]);
+					Vector2d end = base + Vector2d(v[4], v[5]);
+					flattener.cubic(*contour, cur, c1, ctrl, end);
+					cur = end;
+				}
+				break;
+			}
+			case 'Q':
+			case 'T': {
+				if (toupper(cmd) == 'Q') {
+					ok = reader.number(v[0]) && reader.number(v[1]);
+					ctrl = base + Vector2d(v[0], v[1]);
+				}
+				else {
+					bool smooth = (toupper(prevcmd) == 'Q' || toupper(prevcmd) == 'T');
+					ctrl = smooth ? Vector2d(2 * cur - ctrl) : cur;
+				}
+				if ((ok = ok && reader.number(v[2]) && reader.number(v[3]))) {
+					Vector2d end = base + Vector2d(v[2], v[3]);
+					flattener.quadratic(*contour, cur, ctrl, end);
+					cur = end;
+				}
+				break;
+			}
+			case 'A':
+				if ((ok = reader.number(v[0]) && reader.number(v[1]) && reader.number(v[2]) &&
+						 reader.flag(flags[0]) && reader.flag(flags[1]) &&
+						 reader.number(v[3]) && reader.number(v[4]))) {
+					Vector2d end = base + Vector2d(v[3], v[4]);
+					flattener.arc(*contour, cur, v[0], v[1], v[2], flags[0], flags[1], end);
+					cur = end;
+				}
+				break;
+			case 'Z':
+				cur = start;
+				contour = NULL;
+				break;
+			default:
+				PRINTB("WARNING: Unsupported SVG path command '%c'", cmd);
+				ok = false;
+			}
+			if (!ok) {
+				PRINT("WARNING: Malformed SVG path data");
+				break;
+			}
+			prevcmd = cmd;
+		}
+		return true;
+	}
+
+	/*!
+		Builds the shape described by a single element. Returns false if
+		the element doesn't describe an area.
+	*/
+	bool svg_shape(SvgShape &shape, const std::string &name, const SvgAttributes &attribs,
+								 const SvgFlattener &flattener)
+	{
+		if (name == "path") {
+			return svg_path(shape, svg_attribute(attribs, "d"), flattener);
+		}
+		else if (name == "polygon" || name == "polyline") {
+			return svg_points(shape, svg_attribute(attribs, "points"));
+		}
+		else if (name == "rect") {
+			double x = svg_length(attribs, "x"), y = svg_length(attribs, "y");
+			double w = svg_length(attribs, "width"), h = svg_length(attribs, "height");
+			if (w <= 0 || h <= 0) return false;
+			double rx = svg_length(attribs, "rx", -1), ry = svg_length(attribs, "ry", -1);
+			if (rx < 0) rx = std::max(ry, 0.0);
+			if (ry < 0) ry = rx;
+			rx = std::min(rx, w / 2);
+			ry = std::min(ry, h / 2);
+			SvgContour c;
+			if (rx > 0 && ry > 0) {
+				c.push_back(Vector2d(x + rx, y));
+				c.push_back(Vector2d(x + w - rx, y));
+				flattener.arc(c, c.back(), rx, ry, 0, false, true, Vector2d(x + w, y + ry));
+				c.push_back(Vector2d(x + w, y + h - ry));
+				flattener.arc(c, c.back(), rx, ry, 0, false, true, Vector2d(x + w - rx, y + h));
+				c.push_back(Vector2d(x + rx, y + h));
+				flattener.arc(c, c.back(), rx, ry, 0, false, true, Vector2d(x, y + h - ry));
+				c.push_back(Vector2d(x, y + ry));
+				flattener.arc(c, c.back(), rx, ry, 0, false, true, Vector2d(x + rx, y));
+				c.pop_back();
+			}
+			else {
+				c.push_back(Vector2d(x, y));
+				c.push_back(Vector2d(x + w, y));
+				c.push_back(Vector2d(x + w, y + h));
+				c.push_back(Vector2d(x, y + h));
+			}
+			shape.contours.push_back(c);
+			return true;
+		}
+		else if (name == "circle" || name == "ellipse") {
+			double rx, ry;
+			if (name == "circle") rx = ry = svg_length(attribs, "r");
+			else {
+				rx = svg_length(attribs, "rx");
+				ry = svg_length(attribs, "ry");
+			}
+			if (rx <= 0 || ry <= 0) return false;
+			SvgContour c;
+			flattener.ellipse(c, svg_length(attribs, "cx"), svg_length(attribs, "cy"), rx, ry);
+			shape.contours.push_back(c);
+			return true;
+		}
+		return false;
+	}
+
+	bool svg_evenodd(const SvgAttributes &attribs, bool inherited)
+	{
+		std::string rule = svg_attribute(attribs, "fill-rule");
+		std::string style = svg_attribute(attribs, "style");
+		std::string::size_type pos = style.find("fill-rule");
+		if (pos != std::string::npos) {
+			std::string::size_type colon = style.find(':', pos);
+			std::string::size_type end = style.find(';', pos);
+			if (colon != std::string::npos) rule = style.substr(colon + 1, end == std::string::npos ? end : end - colon - 1);
+		}
+		boost::trim(rule);
+		if (rule == "evenodd") return true;
+		if (rule == "nonzero") return false;
+		return inherited;
+	}
+
+	/*!
+		Parses one tag starting at pos (which points to the character after '<').
+		Returns false on a malformed tag.
+	*/
+	bool parse_tag(const std::string &text, std::string::size_type &pos,
+								 std::string &name, SvgAttributes &attribs, bool &closing, bool &selfclosing)
+	{
+		closing = selfclosing = false;
+		if (pos < text.size() && text[pos] == '/') {
+			closing = true;
+			pos++;
+		}
+		std::string::size_type start = pos;
+		while (pos < text.size() && !isspace(text[pos]) && text[pos] != '>' && text[pos] != '/') pos++;
+		name = text.substr(start, pos - start);
+		// Strip namespace prefixes like "svg:"
+		std::string::size_type colon = name.find(':');
+		if (colon != std::string::npos) name = name.substr(colon + 1);
+
+		while (pos < text.size()) {
+			while (pos < text.size() && isspace(text[pos])) pos++;
+			if (pos >= text.size()) return false;
+			if (text[pos] == '>') {
+				pos++;
+				return true;
+			}
+			if (text[pos] == '/') {
+				selfclosing = true;
+				pos++;
+				continue;
+			}
+			start = pos;
+			while (pos < text.size() && text[pos] != '=' && !isspace(text[pos]) && text[pos] != '>') pos++;
+			std::string attrname = text.substr(start, pos - start);
+			while (pos < text.size() && isspace(text[pos])) pos++;
+			if (pos >= text.size() || text[pos] != '=') continue;
+			pos++;
+			while (pos < text.size() && isspace(text[pos])) pos++;
+			if (pos >= text.size()) return false;
+			char quote = text[pos];
+			if (quote != '"' && quote != '\'') return false;
+			std::string::size_type end = text.find(quote, pos + 1);
+			if (end == std::string::npos) return false;
+			attribs[attrname] = text.substr(pos + 1, end - pos - 1);
+			pos = end + 1;
+		}
+		return false;
+	}
+
+	/*!
+		Root transform: flips Y so the drawing is upright and applies
+		origin and scale the same way as DXF import.
+	*/
+	Transform2d svg_root_transform(const SvgAttributes &attribs,
+																 double xorigin, double yorigin, double scale)
+	{
+		double flip = svg_length(attribs, "height");
+		std::string viewbox = svg_attribute(attribs, "viewBox");
+		if (!viewbox.empty()) {
+			NumberReader reader(viewbox);
+			double vb[4];
+			if (reader.number(vb[0]) && reader.number(vb[1]) &&
+					reader.number(vb[2]) && reader.number(vb[3])) {
+				flip = vb[1] + vb[3];
+			}
+		}
+		Transform2d t(Transform2d::Identity());
+		t.scale(scale);
+		t.translate(Vector2d(-xorigin, -yorigin));
+		Transform2d flipy(Transform2d::Identity());
+		flipy.matrix() <<
+			1, 0, 0,
+			0, -1, flip,
+			0, 0, 1;
+		return t * flipy;
+	}
+
+	void add_shape(ClipperLib::Clipper &sumclipper, const SvgShape &shape, const Transform2d &transform)
+	{
+		Polygon2d poly;
+		BOOST_FOREACH(const SvgContour &contour, shape.contours) {
+			if (contour.size() < 3) continue;
+			Outline2d outline;
+			BOOST_FOREACH(const Vector2d &v, contour) outline.vertices.push_back(transform * v);
+			poly.addOutline(outline);
+		}
+		// Keep the orientation, it matters for the nonzero fill rule
+		poly.setSanitized(true);
+		ClipperLib::Paths paths = ClipperUtils::fromPolygon2d(poly);
+		paths = ClipperUtils::process(paths, ClipperLib::ctUnion,
+																	shape.evenodd ? ClipperLib::pftEvenOdd : ClipperLib::pftNonZero);
+		sumclipper.AddPaths(paths, ClipperLib::ptSubject, true);
+	}
+
+	Polygon2d *read_svg(const std::string &text, const SvgFlattener &baseflattener,
+											double xorigin, double yorigin, double scale)
+	{
+		static const char *hidden_elements[] = {
+			"defs", "clipPath", "mask", "pattern", "symbol", "marker",
+			"title", "desc", "metadata", "style", "text", NULL
+		};
+
+		ClipperLib::Clipper sumclipper;
+		SvgFlattener flattener(baseflattener);
+		SvgStateStack stack;
+		SvgState root;
+		root.transform = Transform2d::Identity();
+		root.evenodd = false;
+		root.hidden = false;
+		stack.push_back(root);
+		bool have_root = false;
+
+		std::string::size_type pos = 0;
+		while ((pos = text.find('<', pos)) != std::string::npos) {
+			pos++;
+			if (text.compare(pos, 3, "!--") == 0) {
+				pos = text.find("-->", pos);
+				if (pos == std::string::npos) break;
+				continue;
+			}
+			if (text.compare(pos, 8, "![CDATA[") == 0) {
+				pos = text.find("]]>", pos);
+				if (pos == std::string::npos) break;
+				continue;
+			}
+			if (text[pos] == '?' || text[pos] == '!') {
+				pos = text.find('>', pos);
+				if (pos == std::string::npos) break;
+				continue;
+			}
+
+			std::string name;
+			SvgAttributes attribs;
+			bool closing, selfclosing;
+			if (!parse_tag(text, pos, name, attribs, closing, selfclosing)) {
+				PRINT("WARNING: Malformed SVG file, ignoring the remainder");
+				break;
+			}
+			if (closing) {
+				if (stack.size() > 1) stack.pop_back();
+				continue;
+			}
+
+			SvgState state = stack.back();
+			if (name == "svg" && !have_root) {
+				state.transform = svg_root_transform(attribs, xorigin, yorigin, scale);
+				have_root = true;
+			}
+			std::string transform = svg_attribute(attribs, "transform");
+			if (!transform.empty()) state.transform = state.transform * svg_transform(transform);
+			state.evenodd = svg_evenodd(attribs, state.evenodd);
+			for (int i = 0; hidden_elements[i]; i++) {
+				if (name == hidden_elements[i]) state.hidden = true;
+			}
+			if (svg_attribute(attribs, "display") == "none") state.hidden = true;
+
+			if (!state.hidden) {
+				flattener.unitscale = sqrt(fabs(state.transform.linear().determinant()));
+				SvgShape shape;
+				shape.evenodd = state.evenodd;
+				if (svg_shape(shape, name, attribs, flattener)) {
+					add_shape(sumclipper, shape, state.transform);
+				}
+			}
+			if (!selfclosing) stack.push_back(state);
+		}
+
+		ClipperLib::PolyTree sumresult;
+		sumclipper.Execute(ClipperLib::ctUnion, sumresult, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+		return ClipperUtils::toPolygon2d(sumresult);
+	}
+}
+
+/*!
+	Imports the given SVG file as a sanitized Polygon2d.
+	Never returns NULL; a missing or broken file yields an empty Polygon2d.
+*/
+Polygon2d *import_svg(double fn, double fs, double fa,
+											const std::string &filename,
+											double xorigin, double yorigin, double scale)
+{
+	handle_dep(filename); // Register ourselves as a dependency
+
+	std::ifstream stream(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!stream.good()) {
+		PRINTB("WARNING: Can't open SVG file '%s'.", filename);
+		return new Polygon2d();
+	}
+	std::stringstream text;
+	text << stream.rdbuf();
+
+	return read_svg(text.str(), SvgFlattener(fn, fs, fa), xorigin, yorigin, scale);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <string>
+
+class Polygon2d *import_svg(double fn, double fs, double fa,
+														const std::string &filename,
+														double xorigin = 0.0, double yorigin = 0.0, double scale = 1.0);